@@ -0,0 +1,24 @@
+#ifndef SIT2_HARNESS_H
+#define SIT2_HARNESS_H
+
+struct sit2_sim;
+struct sit2_sim_mux;
+
+struct harness {
+	struct sit2_sim *sim;
+	struct dvb_frontend *fe;
+};
+
+int harness_setup(struct harness *h);
+void harness_teardown(struct harness *h);
+void harness_tune_props(struct dvb_frontend *fe, const struct sit2_sim_mux *m);
+fe_status_t harness_tune(struct harness *h, const struct sit2_sim_mux *m);
+const struct sit2_sim_mux *harness_mux(unsigned int i);
+unsigned int harness_num_mux(void);
+void harness_idle(u32 ms);
+void harness_print_debugfs(const char *name);
+
+int kunit_run_all(void);
+int harness_stress(int argc, char **argv);
+
+#endif
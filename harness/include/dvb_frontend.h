@@ -0,0 +1,228 @@
+/*
+ * The part of dvb_frontend.h and linux/dvb/frontend.h sit2.c needs,
+ * with the uapi values, so the harness tunes like dvb-core would.
+ */
+#ifndef SIT2_SHIM_DVB_FRONTEND_H
+#define SIT2_SHIM_DVB_FRONTEND_H
+
+#include <sit2_shim.h>
+
+typedef enum fe_delivery_system {
+	SYS_UNDEFINED,
+	SYS_DVBC_ANNEX_A,
+	SYS_DVBC_ANNEX_B,
+	SYS_DVBT,
+	SYS_DSS,
+	SYS_DVBS,
+	SYS_DVBS2,
+	SYS_DVBH,
+	SYS_ISDBT,
+	SYS_ISDBS,
+	SYS_ISDBC,
+	SYS_ATSC,
+	SYS_ATSCMH,
+	SYS_DTMB,
+	SYS_CMMB,
+	SYS_DAB,
+	SYS_DVBT2,
+	SYS_TURBO,
+	SYS_DVBC_ANNEX_C,
+} fe_delivery_system_t;
+
+typedef enum fe_status {
+	FE_HAS_SIGNAL	= 0x01,
+	FE_HAS_CARRIER	= 0x02,
+	FE_HAS_VITERBI	= 0x04,
+	FE_HAS_SYNC	= 0x08,
+	FE_HAS_LOCK	= 0x10,
+	FE_TIMEDOUT	= 0x20,
+	FE_REINIT	= 0x40,
+} fe_status_t;
+
+typedef enum fe_modulation {
+	QPSK,
+	QAM_16,
+	QAM_32,
+	QAM_64,
+	QAM_128,
+	QAM_256,
+	QAM_AUTO,
+	VSB_8,
+	VSB_16,
+	PSK_8,
+	APSK_16,
+	APSK_32,
+	DQPSK,
+	QAM_4_NR,
+} fe_modulation_t;
+
+typedef enum fe_transmit_mode {
+	TRANSMISSION_MODE_2K,
+	TRANSMISSION_MODE_8K,
+	TRANSMISSION_MODE_AUTO,
+	TRANSMISSION_MODE_4K,
+	TRANSMISSION_MODE_1K,
+	TRANSMISSION_MODE_16K,
+	TRANSMISSION_MODE_32K,
+	TRANSMISSION_MODE_C1,
+	TRANSMISSION_MODE_C3780,
+} fe_transmit_mode_t;
+
+typedef enum fe_guard_interval {
+	GUARD_INTERVAL_1_32,
+	GUARD_INTERVAL_1_16,
+	GUARD_INTERVAL_1_8,
+	GUARD_INTERVAL_1_4,
+	GUARD_INTERVAL_AUTO,
+	GUARD_INTERVAL_1_128,
+	GUARD_INTERVAL_19_128,
+	GUARD_INTERVAL_19_256,
+	GUARD_INTERVAL_PN420,
+	GUARD_INTERVAL_PN595,
+	GUARD_INTERVAL_PN945,
+} fe_guard_interval_t;
+
+typedef enum fe_hierarchy {
+	HIERARCHY_NONE,
+	HIERARCHY_1,
+	HIERARCHY_2,
+	HIERARCHY_4,
+	HIERARCHY_AUTO,
+} fe_hierarchy_t;
+
+typedef enum fe_code_rate {
+	FEC_NONE = 0,
+	FEC_1_2,
+	FEC_2_3,
+	FEC_3_4,
+	FEC_4_5,
+	FEC_5_6,
+	FEC_6_7,
+	FEC_7_8,
+	FEC_8_9,
+	FEC_AUTO,
+	FEC_3_5,
+	FEC_9_10,
+	FEC_2_5,
+} fe_code_rate_t;
+
+typedef enum fe_spectral_inversion {
+	INVERSION_OFF,
+	INVERSION_ON,
+	INVERSION_AUTO,
+} fe_spectral_inversion_t;
+
+#define NO_STREAM_ID_FILTER	(~0U)
+
+enum fecap_scale_params {
+	FE_SCALE_NOT_AVAILABLE = 0,
+	FE_SCALE_DECIBEL,
+	FE_SCALE_RELATIVE,
+	FE_SCALE_COUNTER,
+};
+
+struct dtv_stats {
+	u8 scale;
+	union {
+		u64 uvalue;
+		s64 svalue;
+	};
+};
+
+#define MAX_DTV_STATS		4
+
+struct dtv_fe_stats {
+	u8 len;
+	struct dtv_stats stat[MAX_DTV_STATS];
+};
+
+struct dtv_frontend_properties {
+	u32 frequency;
+	fe_modulation_t modulation;
+	fe_spectral_inversion_t inversion;
+	u32 symbol_rate;
+	fe_code_rate_t fec_inner;
+	fe_transmit_mode_t transmission_mode;
+	u32 bandwidth_hz;
+	fe_guard_interval_t guard_interval;
+	fe_hierarchy_t hierarchy;
+	fe_code_rate_t code_rate_HP;
+	fe_code_rate_t code_rate_LP;
+	fe_delivery_system_t delivery_system;
+	u32 stream_id;
+	struct dtv_fe_stats strength;
+	struct dtv_fe_stats cnr;
+	struct dtv_fe_stats pre_bit_error;
+	struct dtv_fe_stats pre_bit_count;
+	struct dtv_fe_stats post_bit_error;
+	struct dtv_fe_stats post_bit_count;
+	struct dtv_fe_stats block_error;
+	struct dtv_fe_stats block_count;
+};
+
+#define DVBFE_ALGO_HW		1
+
+#define FE_CAN_FEC_1_2			0x2
+#define FE_CAN_FEC_2_3			0x4
+#define FE_CAN_FEC_3_4			0x8
+#define FE_CAN_FEC_5_6			0x20
+#define FE_CAN_FEC_7_8			0x80
+#define FE_CAN_FEC_AUTO			0x200
+#define FE_CAN_QPSK			0x400
+#define FE_CAN_QAM_16			0x800
+#define FE_CAN_QAM_32			0x1000
+#define FE_CAN_QAM_64			0x2000
+#define FE_CAN_QAM_128			0x4000
+#define FE_CAN_QAM_256			0x8000
+#define FE_CAN_QAM_AUTO			0x10000
+#define FE_CAN_TRANSMISSION_MODE_AUTO	0x20000
+#define FE_CAN_GUARD_INTERVAL_AUTO	0x80000
+#define FE_CAN_HIERARCHY_AUTO		0x100000
+#define FE_CAN_MULTISTREAM		0x4000000
+#define FE_CAN_2G_MODULATION		0x10000000
+#define FE_CAN_MUTE_TS			0x80000000
+
+struct dvb_frontend_info {
+	char name[128];
+	u32 frequency_min;
+	u32 frequency_max;
+	u32 frequency_stepsize;
+	u32 frequency_tolerance;
+	u32 symbol_rate_min;
+	u32 symbol_rate_max;
+	u32 symbol_rate_tolerance;
+	u32 notifier_delay;
+	u32 caps;
+};
+
+struct dvb_frontend;
+
+struct dvb_frontend_ops {
+	struct dvb_frontend_info info;
+	u8 delsys[8];
+	void (*release)(struct dvb_frontend *fe);
+	int (*init)(struct dvb_frontend *fe);
+	int (*sleep)(struct dvb_frontend *fe);
+	int (*tune)(struct dvb_frontend *fe, bool re_tune, unsigned int mode_flags,
+		    unsigned int *delay, fe_status_t *status);
+	int (*get_frontend_algo)(struct dvb_frontend *fe);
+	int (*set_frontend)(struct dvb_frontend *fe);
+	int (*get_frontend)(struct dvb_frontend *fe);
+	int (*read_status)(struct dvb_frontend *fe, fe_status_t *status);
+	int (*read_ber)(struct dvb_frontend *fe, u32 *ber);
+	int (*read_signal_strength)(struct dvb_frontend *fe, u16 *strength);
+	int (*read_snr)(struct dvb_frontend *fe, u16 *snr);
+	int (*read_ucblocks)(struct dvb_frontend *fe, u32 *ucblocks);
+	int (*i2c_gate_ctrl)(struct dvb_frontend *fe, int enable);
+};
+
+struct dvb_frontend {
+	struct dvb_frontend_ops ops;
+	void *demodulator_priv;
+	struct dtv_frontend_properties dtv_property_cache;
+};
+
+/* no frontend thread here, whoever drives ops.tune picks up the retune */
+static inline void dvb_frontend_reinitialise(struct dvb_frontend *fe) { }
+
+#endif
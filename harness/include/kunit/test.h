@@ -0,0 +1,97 @@
+/*
+ * Enough of KUnit to run the sit2 suite in the harness. Suites register
+ * from a constructor; a failed assertion leaves the case with longjmp.
+ */
+#ifndef SIT2_SHIM_KUNIT_TEST_H
+#define SIT2_SHIM_KUNIT_TEST_H
+
+#include <sit2_shim.h>
+#include <setjmp.h>
+
+struct kunit;
+
+struct kunit_case {
+	void (*run_case)(struct kunit *test);
+	const char *name;
+};
+
+struct kunit_suite {
+	const char name[256];
+	int (*init)(struct kunit *test);
+	void (*exit)(struct kunit *test);
+	struct kunit_case *test_cases;
+	struct kunit_suite *next;	/* harness only */
+};
+
+struct kunit {
+	void *priv;
+	const char *name;
+	bool failed;
+	jmp_buf abort;
+	void *res[8];		/* kunit_kzalloc memory, freed after the case */
+	int num_res;
+};
+
+#define KUNIT_CASE(fn)		{ .run_case = fn, .name = #fn }
+
+void kunit_register_suite(struct kunit_suite *suite);
+void kunit_fail(struct kunit *test, bool fatal, const char *file, int line,
+		const char *fmt, ...) __attribute__((format(printf, 5, 6)));
+
+#define kunit_test_suite(suite)						\
+	static void __attribute__((constructor)) __kunit_reg_##suite(void) \
+	{								\
+		kunit_register_suite(&suite);				\
+	}
+
+void *kunit_kzalloc(struct kunit *test, size_t size, gfp_t gfp);
+static inline void *kunit_kcalloc(struct kunit *test, size_t n, size_t size, gfp_t gfp)
+{
+	return kunit_kzalloc(test, n * size, gfp);
+}
+
+#define kunit_info(test, fmt, ...)	printf("    # %s: " fmt, (test)->name, ##__VA_ARGS__)
+#define kunit_err(test, fmt, ...)	printf("    # %s: " fmt, (test)->name, ##__VA_ARGS__)
+
+#define __KUNIT_CHECK(test, fatal, cond, fmt, ...)				\
+	do {									\
+		if (!(cond))							\
+			kunit_fail(test, fatal, __FILE__, __LINE__, fmt, ##__VA_ARGS__); \
+	} while (0)
+
+#define __KUNIT_BINARY(test, fatal, l, op, r, fmt, ...)			\
+	do {									\
+		long long __l = (long long)(l), __r = (long long)(r);		\
+		if (!(__l op __r))						\
+			kunit_fail(test, fatal, __FILE__, __LINE__,		\
+				   "%s %s %s (%lld %s %lld) " fmt, #l, #op, #r,	\
+				   __l, #op, __r, ##__VA_ARGS__);		\
+	} while (0)
+
+#define KUNIT_EXPECT_TRUE(test, c)	__KUNIT_CHECK(test, false, c, "%s", #c)
+#define KUNIT_EXPECT_FALSE(test, c)	__KUNIT_CHECK(test, false, !(c), "!%s", #c)
+#define KUNIT_ASSERT_TRUE(test, c)	__KUNIT_CHECK(test, true, c, "%s", #c)
+#define KUNIT_ASSERT_FALSE(test, c)	__KUNIT_CHECK(test, true, !(c), "!%s", #c)
+#define KUNIT_EXPECT_NOT_NULL(test, p)	__KUNIT_CHECK(test, false, (p) != NULL, "%s != NULL", #p)
+#define KUNIT_ASSERT_NOT_NULL(test, p)	__KUNIT_CHECK(test, true, (p) != NULL, "%s != NULL", #p)
+#define KUNIT_ASSERT_NOT_ERR_OR_NULL(test, p) \
+	__KUNIT_CHECK(test, true, (p) && !IS_ERR(p), "%s", #p)
+#define KUNIT_EXPECT_EQ(test, l, r)	__KUNIT_BINARY(test, false, l, ==, r, "")
+#define KUNIT_EXPECT_NE(test, l, r)	__KUNIT_BINARY(test, false, l, !=, r, "")
+#define KUNIT_EXPECT_LE(test, l, r)	__KUNIT_BINARY(test, false, l, <=, r, "")
+#define KUNIT_EXPECT_LT(test, l, r)	__KUNIT_BINARY(test, false, l, <, r, "")
+#define KUNIT_EXPECT_GE(test, l, r)	__KUNIT_BINARY(test, false, l, >=, r, "")
+#define KUNIT_EXPECT_GT(test, l, r)	__KUNIT_BINARY(test, false, l, >, r, "")
+#define KUNIT_ASSERT_EQ(test, l, r)	__KUNIT_BINARY(test, true, l, ==, r, "")
+#define KUNIT_ASSERT_LE(test, l, r)	__KUNIT_BINARY(test, true, l, <=, r, "")
+#define KUNIT_ASSERT_GE(test, l, r)	__KUNIT_BINARY(test, true, l, >=, r, "")
+#define KUNIT_EXPECT_STREQ(test, l, r) \
+	__KUNIT_CHECK(test, false, !strcmp(l, r), "%s == %s (\"%s\" == \"%s\")", #l, #r, l, r)
+#define KUNIT_EXPECT_EQ_MSG(test, l, r, fmt, ...) \
+	__KUNIT_BINARY(test, false, l, ==, r, ": " fmt, ##__VA_ARGS__)
+#define KUNIT_EXPECT_LE_MSG(test, l, r, fmt, ...) \
+	__KUNIT_BINARY(test, false, l, <=, r, ": " fmt, ##__VA_ARGS__)
+#define KUNIT_EXPECT_TRUE_MSG(test, c, fmt, ...) \
+	__KUNIT_CHECK(test, false, c, "%s: " fmt, #c, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,2 @@
+#include <asm/errno.h>
+#include <sit2_shim.h>
@@ -0,0 +1 @@
+#include <sit2_shim.h>
@@ -0,0 +1,16 @@
+/* stand-in for the bridge-facing sit2.h of the media_build tree */
+#ifndef SIT2_SHIM_SIT2_H
+#define SIT2_SHIM_SIT2_H
+
+#include "dvb_frontend.h"
+
+struct sit2_config {
+	u8 ts_bus_mode;		/* 1: serial, 2: parallel */
+	u8 ts_clock_mode;	/* 0: auto, 1: manual */
+	int (*start_ctrl)(struct dvb_frontend *fe);
+};
+
+struct dvb_frontend *sit2_attach(const struct sit2_config *config,
+				 struct i2c_adapter *i2c);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ * Userspace stand-ins for the kernel APIs sit2.c and sit2_sim.c use.
+ * Time is virtual by default: sleeps advance the clock instead of
+ * waiting, so a simulated tune costs no wall time. The stress mode
+ * switches to a scaled real clock so several threads can run at once.
+ */
+#ifndef SIT2_SHIM_H
+#define SIT2_SHIM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+typedef u16 __le16;
+typedef u32 __le32;
+typedef unsigned int gfp_t;
+typedef s64 ktime_t;
+
+#ifndef LINUX_VERSION_CODE
+#define LINUX_VERSION_CODE	KERNEL_VERSION(6, 12, 0)
+#endif
+#define KERNEL_VERSION(a, b, c)	(((a) << 16) + ((b) << 8) + (c))
+
+/* kconfig.h: true when the option is defined to 1, as the build sets them */
+#define __ARG_PLACEHOLDER_1	0,
+#define __take_second_arg(__ignored, val, ...) val
+#define __is_defined(x)		___is_defined(x)
+#define ___is_defined(val)	____is_defined(__ARG_PLACEHOLDER_##val)
+#define ____is_defined(arg1_or_junk) __take_second_arg(arg1_or_junk 1, 0)
+#define IS_ENABLED(option)	__is_defined(option)
+
+#define GFP_KERNEL		0
+#define KERN_INFO		""
+#define KERN_ERR		""
+#define KERN_WARNING		""
+#define KBUILD_MODNAME		"sit2"
+#define HZ			1000
+#define L1_CACHE_BYTES		64
+#define __user
+#define __init
+#define __exit
+#define __packed		__attribute__((packed))
+#define __aligned(x)		__attribute__((aligned(x)))
+#define fallthrough		__attribute__((fallthrough))
+#define ____cacheline_aligned	__aligned(L1_CACHE_BYTES)
+#define ARCH_KMALLOC_MINALIGN	8
+#define likely(x)		(x)
+#define unlikely(x)		(x)
+#define READ_ONCE(x)		(*(volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, v)	(*(volatile typeof(x) *)&(x) = (v))
+#define BUILD_BUG_ON(x)		((void)sizeof(char[1 - 2 * !!(x)]))
+#define lockdep_assert_held(x)	((void)(x))
+
+typedef struct { int counter; } atomic_t;
+#define atomic_read(v)		__atomic_load_n(&(v)->counter, __ATOMIC_SEQ_CST)
+#define atomic_set(v, i)	__atomic_store_n(&(v)->counter, i, __ATOMIC_SEQ_CST)
+#define atomic_inc(v)		((void)__atomic_add_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST))
+
+#define U16_MAX			0xffff
+#define U32_MAX			0xffffffffU
+#define KTIME_MAX		LLONG_MAX
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#define ALIGN(x, a)		(((x) + (a) - 1) & ~((a) - 1))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define min(a, b)		({ typeof(a) _a = (a); typeof(b) _b = (b); _a < _b ? _a : _b; })
+#define max(a, b)		({ typeof(a) _a = (a); typeof(b) _b = (b); _a > _b ? _a : _b; })
+#define min_t(t, a, b)		({ t _a = (a); t _b = (b); _a < _b ? _a : _b; })
+#define max_t(t, a, b)		({ t _a = (a); t _b = (b); _a > _b ? _a : _b; })
+#define clamp(v, lo, hi)	min(max(v, lo), hi)
+#define clamp_t(t, v, lo, hi)	min_t(t, max_t(t, v, lo), hi)
+#define clamp_val(v, lo, hi)	clamp_t(typeof(v), v, lo, hi)
+#define abs(x)			({ typeof(x) _x = (x); _x < 0 ? -_x : _x; })
+
+#define cpu_to_le16(x)		((__le16)(x))
+#define cpu_to_le32(x)		((__le32)(x))
+#define le16_to_cpu(x)		((u16)(x))
+#define le32_to_cpu(x)		((u32)(x))
+
+/* module glue */
+struct module { int unused; };
+extern struct module __this_module;
+#define THIS_MODULE		(&__this_module)
+#define EXPORT_SYMBOL(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_VERSION(x)
+#define MODULE_PARM_DESC(a, b)
+#define module_param(name, type, perm)
+#define module_param_array(name, type, nump, perm)
+
+int printk(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+extern int shim_quiet;
+
+struct device {
+	void *driver_data;
+};
+#define dev_err(d, ...)		printk(__VA_ARGS__)
+#define dev_warn(d, ...)	printk(__VA_ARGS__)
+#define dev_info(d, ...)	printk(__VA_ARGS__)
+#define dev_dbg(d, ...)		do { } while (0)
+static inline const char *dev_name(const struct device *dev) { return "sit2-shim"; }
+
+/* memory */
+void *kzalloc(size_t size, gfp_t gfp);
+void *kmalloc(size_t size, gfp_t gfp);
+void *kcalloc(size_t n, size_t size, gfp_t gfp);
+void *kmemdup(const void *src, size_t len, gfp_t gfp);
+void kfree(const void *p);
+static inline void devm_kfree(struct device *dev, const void *p) { kfree(p); }
+void *vmalloc(unsigned long size);
+void vfree(const void *p);
+void *memdup_user_nul(const void *src, size_t len);
+#define ERR_PTR(e)		((void *)(long)(e))
+#define PTR_ERR(p)		((long)(p))
+#define IS_ERR(p)		((unsigned long)(p) >= (unsigned long)-4095)
+unsigned long copy_from_user(void *to, const void *from, unsigned long n);
+unsigned long copy_to_user(void *to, const void *from, unsigned long n);
+ssize_t simple_read_from_buffer(void *to, size_t count, loff_t *ppos,
+				const void *from, size_t available);
+
+/* strings */
+char *strim(char *s);
+char *skip_spaces(const char *s);
+int kstrtouint(const char *s, unsigned int base, unsigned int *res);
+int kstrtoint(const char *s, unsigned int base, int *res);
+size_t strscpy(char *dst, const char *src, size_t size);
+u32 crc32_le(u32 crc, const unsigned char *p, size_t len);
+#define crc32(seed, data, len)	crc32_le(seed, data, len)
+
+/* math */
+static inline u64 div_u64(u64 n, u32 d) { return n / d; }
+static inline u64 div64_u64(u64 n, u64 d) { return n / d; }
+static inline s64 div_s64(s64 n, s32 d) { return n / d; }
+static inline int fls64(u64 x) { return x ? 64 - __builtin_clzll(x) : 0; }
+static inline int fls(unsigned int x) { return x ? 32 - __builtin_clz(x) : 0; }
+static inline unsigned long __fls(unsigned long x) { return 63 - __builtin_clzl(x); }
+#define ilog2(n)		(fls64(n) - 1)
+#define do_div(n, base)		({ u32 __r = (n) % (base); (n) /= (base); __r; })
+u32 intlog10(u32 value);
+
+/* time */
+enum shim_clock {
+	SHIM_CLOCK_VIRTUAL = 0,	/* sleeps advance the clock, one thread */
+	SHIM_CLOCK_SCALED,	/* real time, sleeps shortened by shim_scale */
+};
+extern enum shim_clock shim_clock_mode;
+extern unsigned int shim_scale;
+ktime_t ktime_get(void);
+void shim_advance_us(u64 us);
+void msleep(unsigned int ms);
+void usleep_range(unsigned long min_us, unsigned long max_us);
+void udelay(unsigned long us);
+#define NSEC_PER_USEC		1000LL
+#define NSEC_PER_MSEC		1000000LL
+static inline ktime_t ktime_add_us(ktime_t k, u64 us) { return k + (s64)us * NSEC_PER_USEC; }
+static inline ktime_t ktime_add_ms(ktime_t k, u64 ms) { return k + (s64)ms * NSEC_PER_MSEC; }
+static inline s64 ktime_us_delta(ktime_t a, ktime_t b) { return (a - b) / NSEC_PER_USEC; }
+static inline s64 ktime_ms_delta(ktime_t a, ktime_t b) { return (a - b) / NSEC_PER_MSEC; }
+static inline s64 ktime_to_us(ktime_t k) { return k / NSEC_PER_USEC; }
+static inline s64 ktime_to_ms(ktime_t k) { return k / NSEC_PER_MSEC; }
+static inline s64 ktime_to_ns(ktime_t k) { return k; }
+static inline u64 ktime_get_ns(void) { return ktime_get(); }
+unsigned long msleep_interruptible(unsigned int ms);
+static inline bool ktime_before(ktime_t a, ktime_t b) { return a < b; }
+static inline bool ktime_after(ktime_t a, ktime_t b) { return a > b; }
+static inline ktime_t ktime_sub(ktime_t a, ktime_t b) { return a - b; }
+#define jiffies			((unsigned long)ktime_to_ms(ktime_get()))
+static inline unsigned long msecs_to_jiffies(unsigned int ms) { return ms; }
+static inline unsigned int jiffies_to_msecs(unsigned long j) { return j; }
+#define time_after(a, b)	((long)((b) - (a)) < 0)
+#define time_before(a, b)	time_after(b, a)
+
+/* locking */
+struct mutex {
+	pthread_mutex_t m;
+};
+void mutex_init(struct mutex *lock);
+void mutex_lock(struct mutex *lock);
+void mutex_unlock(struct mutex *lock);
+int mutex_trylock(struct mutex *lock);
+int mutex_is_locked(struct mutex *lock);
+static inline void mutex_destroy(struct mutex *lock) { }
+typedef struct {
+	pthread_mutex_t m;
+} spinlock_t;
+static inline void spin_lock_init(spinlock_t *l) { pthread_mutex_init(&l->m, NULL); }
+static inline void spin_lock(spinlock_t *l) { pthread_mutex_lock(&l->m); }
+static inline void spin_unlock(spinlock_t *l) { pthread_mutex_unlock(&l->m); }
+#define spin_lock_irqsave(l, f)	((void)(f), spin_lock(l))
+#define spin_unlock_irqrestore(l, f) spin_unlock(l)
+struct task_struct;
+struct task_struct *shim_current(void);
+#define current			shim_current()
+
+/* work */
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+struct work_struct {
+	work_func_t func;
+};
+struct delayed_work {
+	struct work_struct work;
+	ktime_t due;
+	bool pending;
+	bool running;
+	struct delayed_work *next;
+};
+#define INIT_DELAYED_WORK(w, f)	shim_init_delayed_work(w, f)
+#define to_delayed_work(w)	container_of(w, struct delayed_work, work)
+void shim_init_delayed_work(struct delayed_work *dw, work_func_t func);
+bool schedule_delayed_work(struct delayed_work *dw, unsigned long delay);
+bool mod_delayed_work(void *wq, struct delayed_work *dw, unsigned long delay);
+bool cancel_delayed_work(struct delayed_work *dw);
+bool cancel_delayed_work_sync(struct delayed_work *dw);
+bool flush_delayed_work(struct delayed_work *dw);
+bool delayed_work_pending(struct delayed_work *dw);
+extern void *system_wq;
+/* run the works that are due, returns how many ran */
+int shim_run_works(void);
+/* time of the next due work, KTIME_MAX if none */
+ktime_t shim_next_work(void);
+
+/* power management */
+#define PM_HIBERNATION_PREPARE	0x0001
+#define PM_POST_HIBERNATION	0x0002
+#define PM_SUSPEND_PREPARE	0x0003
+#define PM_POST_SUSPEND		0x0004
+#define NOTIFY_DONE		0x0000
+struct notifier_block {
+	int (*notifier_call)(struct notifier_block *nb, unsigned long action, void *data);
+	struct notifier_block *next;
+};
+int register_pm_notifier(struct notifier_block *nb);
+int unregister_pm_notifier(struct notifier_block *nb);
+void shim_pm_notify(unsigned long action);
+
+/* i2c */
+#define I2C_M_RD		0x0001
+#define I2C_M_DMA_SAFE		0x0200
+#define I2C_FUNC_I2C		0x00000001
+#define I2C_LOCK_ROOT_ADAPTER	0x01
+#define I2C_LOCK_SEGMENT	0x02
+#define I2C_MUX_LOCKED		0x01
+struct i2c_msg {
+	u16 addr;
+	u16 flags;
+	u16 len;
+	u8 *buf;
+};
+struct i2c_adapter;
+struct i2c_algorithm {
+	int (*master_xfer)(struct i2c_adapter *adap, struct i2c_msg *msgs, int num);
+	u32 (*functionality)(struct i2c_adapter *adap);
+};
+struct i2c_mux_core;
+struct i2c_adapter {
+	struct module *owner;
+	const struct i2c_algorithm *algo;
+	struct device dev;
+	int nr;
+	char name[48];
+	pthread_mutex_t bus_lock;
+	struct i2c_mux_core *mux;	/* set on a mux child */
+};
+int i2c_add_adapter(struct i2c_adapter *adap);
+void i2c_del_adapter(struct i2c_adapter *adap);
+int i2c_transfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num);
+int __i2c_transfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num);
+void i2c_lock_bus(struct i2c_adapter *adap, unsigned int flags);
+void i2c_unlock_bus(struct i2c_adapter *adap, unsigned int flags);
+static inline int i2c_adapter_id(struct i2c_adapter *adap) { return adap->nr; }
+static inline void *i2c_get_adapdata(struct i2c_adapter *adap) { return adap->dev.driver_data; }
+static inline void i2c_set_adapdata(struct i2c_adapter *adap, void *data) { adap->dev.driver_data = data; }
+struct i2c_mux_core {
+	struct i2c_adapter *parent;
+	void *priv;
+	int (*select)(struct i2c_mux_core *muxc, u32 chan);
+	int (*deselect)(struct i2c_mux_core *muxc, u32 chan);
+	int num_adapters;
+	struct i2c_adapter *adapter[1];
+};
+struct i2c_mux_core *i2c_mux_alloc(struct i2c_adapter *parent, struct device *dev,
+				   int max_adapters, int sizeof_priv, u32 flags,
+				   int (*select)(struct i2c_mux_core *, u32),
+				   int (*deselect)(struct i2c_mux_core *, u32));
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+int i2c_mux_add_adapter(struct i2c_mux_core *muxc, u32 force_nr, u32 chan_id);
+#else
+int i2c_mux_add_adapter(struct i2c_mux_core *muxc, u32 force_nr, u32 chan_id,
+			unsigned int class);
+#endif
+void i2c_mux_del_adapters(struct i2c_mux_core *muxc);
+static inline void *i2c_mux_priv(struct i2c_mux_core *muxc) { return muxc->priv; }
+
+/* debugfs and seq_file */
+typedef unsigned short umode_t;
+struct inode {
+	void *i_private;
+};
+struct seq_file {
+	char *buf;
+	size_t size;
+	size_t count;
+	void *private;
+	int (*show)(struct seq_file *s, void *data);
+};
+struct file {
+	void *private_data;
+};
+struct file_operations {
+	struct module *owner;
+	int (*open)(struct inode *inode, struct file *file);
+	ssize_t (*read)(struct file *file, char *buf, size_t len, loff_t *ppos);
+	ssize_t (*write)(struct file *file, const char *buf, size_t len, loff_t *ppos);
+	loff_t (*llseek)(struct file *file, loff_t off, int whence);
+	int (*release)(struct inode *inode, struct file *file);
+};
+struct dentry;
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+struct dentry *debugfs_create_file(const char *name, umode_t mode, struct dentry *parent,
+				   void *data, const struct file_operations *fops);
+void debugfs_remove_recursive(struct dentry *dentry);
+void debugfs_create_u32(const char *name, umode_t mode, struct dentry *parent, u32 *value);
+void debugfs_create_u64(const char *name, umode_t mode, struct dentry *parent, u64 *value);
+void debugfs_create_bool(const char *name, umode_t mode, struct dentry *parent, bool *value);
+int seq_printf(struct seq_file *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void seq_puts(struct seq_file *s, const char *str);
+void seq_putc(struct seq_file *s, char c);
+int seq_write(struct seq_file *s, const void *data, size_t len);
+int single_open(struct file *file, int (*show)(struct seq_file *, void *), void *data);
+int single_release(struct inode *inode, struct file *file);
+ssize_t seq_read(struct file *file, char *buf, size_t len, loff_t *ppos);
+loff_t seq_lseek(struct file *file, loff_t off, int whence);
+int simple_open(struct inode *inode, struct file *file);
+loff_t no_llseek(struct file *file, loff_t off, int whence);
+/* read a debugfs file of the last attached device into buf */
+int shim_debugfs_read(const char *name, char *buf, size_t size);
+int shim_debugfs_write(const char *name, const char *buf);
+int shim_debugfs_write_buf(const char *name, const void *buf, size_t len);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * KUnit runner of the harness, prints KTAP like the kernel does.
+ */
+#include <sit2_shim.h>
+#include <stdarg.h>
+#include <kunit/test.h>
+#include "dvb_frontend.h"
+#include "harness.h"
+
+static struct kunit_suite *kunit_suites;
+
+void kunit_register_suite(struct kunit_suite *suite)
+{
+	struct kunit_suite **p = &kunit_suites;
+
+	while (*p)
+		p = &(*p)->next;
+	suite->next = NULL;
+	*p = suite;
+}
+
+void kunit_fail(struct kunit *test, bool fatal, const char *file, int line,
+		const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("    # %s: %s at %s:%d\n    ", test->name,
+	       fatal ? "ASSERTION FAILED" : "EXPECTATION FAILED", file, line);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	test->failed = true;
+	if (fatal)
+		longjmp(test->abort, 1);
+}
+
+void *kunit_kzalloc(struct kunit *test, size_t size, gfp_t gfp)
+{
+	void *p;
+
+	if (test->num_res >= ARRAY_SIZE(test->res))
+		return NULL;
+	p = kzalloc(size, gfp);
+	if (p)
+		test->res[test->num_res++] = p;
+	return p;
+}
+
+static int kunit_run_suite(struct kunit_suite *suite, int index)
+{
+	struct kunit_case *c;
+	struct kunit test;
+	int n = 0, i = 0, failed = 0;
+
+	for (c = suite->test_cases; c->run_case; c++)
+		n++;
+	printf("    # Subtest: %s\n    1..%d\n", suite->name, n);
+	for (c = suite->test_cases; c->run_case; c++) {
+		memset(&test, 0, sizeof(test));
+		test.name = c->name;
+		if (suite->init && suite->init(&test)) {
+			test.failed = true;
+		} else {
+			if (!setjmp(test.abort))
+				c->run_case(&test);
+			if (suite->exit)
+				suite->exit(&test);
+		}
+		while (test.num_res)
+			kfree(test.res[--test.num_res]);
+		printf("    %s %d %s\n", test.failed ? "not ok" : "ok", ++i, c->name);
+		failed += test.failed;
+	}
+	printf("%s %d %s\n", failed ? "not ok" : "ok", index, suite->name);
+	return failed;
+}
+
+int kunit_run_all(void)
+{
+	struct kunit_suite *suite;
+	int n = 0, i = 0, failed = 0;
+
+	for (suite = kunit_suites; suite; suite = suite->next)
+		n++;
+	printf("KTAP version 1\n1..%d\n", n);
+	for (suite = kunit_suites; suite; suite = suite->next)
+		failed += kunit_run_suite(suite, ++i) ? 1 : 0;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,850 @@
+/*
+ * Userspace implementation of the kernel API subset in sit2_shim.h.
+ */
+#define _GNU_SOURCE
+#include <sit2_shim.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <malloc.h>
+
+struct module __this_module;
+int shim_quiet;
+void *system_wq;
+
+/* ---- printing and memory ---- */
+
+int printk(const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	if (shim_quiet)
+		return 0;
+	va_start(ap, fmt);
+	ret = vprintf(fmt, ap);
+	va_end(ap);
+	return ret;
+}
+
+void *kzalloc(size_t size, gfp_t gfp)
+{
+	return calloc(1, size);
+}
+
+void *kmalloc(size_t size, gfp_t gfp)
+{
+	return malloc(size);
+}
+
+void *kcalloc(size_t n, size_t size, gfp_t gfp)
+{
+	return calloc(n, size);
+}
+
+void *kmemdup(const void *src, size_t len, gfp_t gfp)
+{
+	void *p = malloc(len);
+
+	if (p)
+		memcpy(p, src, len);
+	return p;
+}
+
+static void shim_forget_works(void *start, size_t len);
+
+void kfree(const void *p)
+{
+	/* a driver state going away takes its works with it */
+	if (p)
+		shim_forget_works((void *)p, malloc_usable_size((void *)p));
+	free((void *)p);
+}
+
+void *vmalloc(unsigned long size)
+{
+	return malloc(size);
+}
+
+void vfree(const void *p)
+{
+	free((void *)p);
+}
+
+void *memdup_user_nul(const void *src, size_t len)
+{
+	char *p = malloc(len + 1);
+
+	if (!p)
+		return ERR_PTR(-ENOMEM);
+	memcpy(p, src, len);
+	p[len] = 0;
+	return p;
+}
+
+unsigned long copy_from_user(void *to, const void *from, unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+unsigned long copy_to_user(void *to, const void *from, unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+ssize_t simple_read_from_buffer(void *to, size_t count, loff_t *ppos,
+				const void *from, size_t available)
+{
+	loff_t pos = *ppos;
+
+	if (pos < 0)
+		return -EINVAL;
+	if (pos >= (loff_t)available || !count)
+		return 0;
+	if (count > available - pos)
+		count = available - pos;
+	memcpy(to, (const char *)from + pos, count);
+	*ppos = pos + count;
+	return count;
+}
+
+/* ---- strings and math ---- */
+
+char *skip_spaces(const char *s)
+{
+	while (isspace((unsigned char)*s))
+		s++;
+	return (char *)s;
+}
+
+char *strim(char *s)
+{
+	size_t len = strlen(s);
+
+	while (len && isspace((unsigned char)s[len - 1]))
+		s[--len] = 0;
+	return skip_spaces(s);
+}
+
+size_t strscpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strnlen(src, size);
+
+	if (!size)
+		return -E2BIG;
+	if (len == size) {
+		memcpy(dst, src, size - 1);
+		dst[size - 1] = 0;
+		return -E2BIG;
+	}
+	memcpy(dst, src, len + 1);
+	return len;
+}
+
+int kstrtouint(const char *s, unsigned int base, unsigned int *res)
+{
+	unsigned long v;
+	char *end;
+
+	errno = 0;
+	v = strtoul(s, &end, base);
+	if (end == s || errno || v > UINT_MAX || *s == '-')
+		return -EINVAL;
+	if (*end == '\n')
+		end++;
+	if (*end)
+		return -EINVAL;
+	*res = v;
+	return 0;
+}
+
+int kstrtoint(const char *s, unsigned int base, int *res)
+{
+	long v;
+	char *end;
+
+	errno = 0;
+	v = strtol(s, &end, base);
+	if (end == s || errno || v > INT_MAX || v < INT_MIN)
+		return -EINVAL;
+	if (*end == '\n')
+		end++;
+	if (*end)
+		return -EINVAL;
+	*res = v;
+	return 0;
+}
+
+u32 crc32_le(u32 crc, const unsigned char *p, size_t len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+	}
+	return crc;
+}
+
+/* log10(value) in 8.24 fixed point, as dvb_math.c */
+u32 intlog10(u32 value)
+{
+	if (!value)
+		return 0;
+	return (u32)(log10((double)value) * 16777216.0);
+}
+
+/* ---- time ---- */
+
+enum shim_clock shim_clock_mode = SHIM_CLOCK_VIRTUAL;
+unsigned int shim_scale = 1;
+static s64 shim_vclock_ns = 1000 * NSEC_PER_MSEC;
+static pthread_mutex_t shim_time_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static s64 shim_real_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (s64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+ktime_t ktime_get(void)
+{
+	static s64 base;
+	s64 now;
+
+	pthread_mutex_lock(&shim_time_lock);
+	if (shim_clock_mode == SHIM_CLOCK_VIRTUAL) {
+		now = shim_vclock_ns;
+	} else {
+		/* carry on from the virtual clock, so time never goes back */
+		if (!base)
+			base = shim_real_ns() - shim_vclock_ns / shim_scale;
+		now = (shim_real_ns() - base) * shim_scale;
+	}
+	pthread_mutex_unlock(&shim_time_lock);
+	return now;
+}
+
+void shim_advance_us(u64 us)
+{
+	struct timespec ts;
+	u64 ns;
+
+	if (shim_clock_mode == SHIM_CLOCK_VIRTUAL) {
+		pthread_mutex_lock(&shim_time_lock);
+		shim_vclock_ns += us * NSEC_PER_USEC;
+		pthread_mutex_unlock(&shim_time_lock);
+		return;
+	}
+	ns = us * NSEC_PER_USEC / shim_scale;
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	nanosleep(&ts, NULL);
+}
+
+void msleep(unsigned int ms)
+{
+	shim_advance_us((u64)ms * 1000);
+}
+
+unsigned long msleep_interruptible(unsigned int ms)
+{
+	msleep(ms);
+	return 0;
+}
+
+void usleep_range(unsigned long min_us, unsigned long max_us)
+{
+	shim_advance_us(min_us);
+}
+
+void udelay(unsigned long us)
+{
+	shim_advance_us(us);
+}
+
+/* ---- locking ---- */
+
+void mutex_init(struct mutex *lock)
+{
+	pthread_mutexattr_t attr;
+
+	/* a self deadlock aborts instead of hanging the run */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+	pthread_mutex_init(&lock->m, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void mutex_lock(struct mutex *lock)
+{
+	if (pthread_mutex_lock(&lock->m)) {
+		fprintf(stderr, "shim: mutex %p locked twice\n", (void *)lock);
+		abort();
+	}
+}
+
+void mutex_unlock(struct mutex *lock)
+{
+	if (pthread_mutex_unlock(&lock->m)) {
+		fprintf(stderr, "shim: mutex %p not held\n", (void *)lock);
+		abort();
+	}
+}
+
+int mutex_trylock(struct mutex *lock)
+{
+	return pthread_mutex_trylock(&lock->m) == 0;
+}
+
+int mutex_is_locked(struct mutex *lock)
+{
+	if (pthread_mutex_trylock(&lock->m))
+		return 1;
+	pthread_mutex_unlock(&lock->m);
+	return 0;
+}
+
+struct task_struct *shim_current(void)
+{
+	static __thread char me;
+
+	return (struct task_struct *)&me;
+}
+
+/* ---- delayed work ---- */
+
+static struct delayed_work *shim_works;
+static pthread_mutex_t shim_work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shim_work_done = PTHREAD_COND_INITIALIZER;
+static struct task_struct *shim_work_runner;
+
+static void shim_unlink_work(struct delayed_work *dw)
+{
+	struct delayed_work **p;
+
+	for (p = &shim_works; *p; p = &(*p)->next)
+		if (*p == dw) {
+			*p = dw->next;
+			return;
+		}
+}
+
+void shim_init_delayed_work(struct delayed_work *dw, work_func_t func)
+{
+	pthread_mutex_lock(&shim_work_lock);
+	shim_unlink_work(dw);
+	memset(dw, 0, sizeof(*dw));
+	dw->work.func = func;
+	dw->next = shim_works;
+	shim_works = dw;
+	pthread_mutex_unlock(&shim_work_lock);
+}
+
+bool mod_delayed_work(void *wq, struct delayed_work *dw, unsigned long delay)
+{
+	bool was;
+
+	pthread_mutex_lock(&shim_work_lock);
+	was = dw->pending;
+	dw->pending = true;
+	dw->due = ktime_add_ms(ktime_get(), delay);
+	pthread_mutex_unlock(&shim_work_lock);
+	return was;
+}
+
+bool schedule_delayed_work(struct delayed_work *dw, unsigned long delay)
+{
+	bool queued = false;
+
+	pthread_mutex_lock(&shim_work_lock);
+	if (!dw->pending) {
+		dw->pending = true;
+		dw->due = ktime_add_ms(ktime_get(), delay);
+		queued = true;
+	}
+	pthread_mutex_unlock(&shim_work_lock);
+	return queued;
+}
+
+bool cancel_delayed_work(struct delayed_work *dw)
+{
+	bool was;
+
+	pthread_mutex_lock(&shim_work_lock);
+	was = dw->pending;
+	dw->pending = false;
+	pthread_mutex_unlock(&shim_work_lock);
+	return was;
+}
+
+bool cancel_delayed_work_sync(struct delayed_work *dw)
+{
+	bool was;
+
+	pthread_mutex_lock(&shim_work_lock);
+	was = dw->pending;
+	dw->pending = false;
+	while (dw->running && shim_work_runner != current)
+		pthread_cond_wait(&shim_work_done, &shim_work_lock);
+	pthread_mutex_unlock(&shim_work_lock);
+	return was;
+}
+
+bool delayed_work_pending(struct delayed_work *dw)
+{
+	return dw->pending;
+}
+
+static bool shim_run_one(struct delayed_work *dw)
+{
+	pthread_mutex_lock(&shim_work_lock);
+	if (!dw->pending || dw->running) {
+		pthread_mutex_unlock(&shim_work_lock);
+		return false;
+	}
+	dw->pending = false;
+	dw->running = true;
+	shim_work_runner = current;
+	pthread_mutex_unlock(&shim_work_lock);
+	dw->work.func(&dw->work);
+	pthread_mutex_lock(&shim_work_lock);
+	dw->running = false;
+	shim_work_runner = NULL;
+	pthread_cond_broadcast(&shim_work_done);
+	pthread_mutex_unlock(&shim_work_lock);
+	return true;
+}
+
+bool flush_delayed_work(struct delayed_work *dw)
+{
+	return shim_run_one(dw);
+}
+
+int shim_run_works(void)
+{
+	struct delayed_work *dw, *due;
+	ktime_t now;
+	int ran = 0;
+
+	for (;;) {
+		due = NULL;
+		now = ktime_get();
+		pthread_mutex_lock(&shim_work_lock);
+		for (dw = shim_works; dw; dw = dw->next)
+			if (dw->pending && !dw->running && dw->due <= now &&
+			    (!due || dw->due < due->due))
+				due = dw;
+		pthread_mutex_unlock(&shim_work_lock);
+		if (!due || !shim_run_one(due))
+			return ran;
+		ran++;
+	}
+}
+
+ktime_t shim_next_work(void)
+{
+	struct delayed_work *dw;
+	ktime_t next = KTIME_MAX;
+
+	pthread_mutex_lock(&shim_work_lock);
+	for (dw = shim_works; dw; dw = dw->next)
+		if (dw->pending && dw->due < next)
+			next = dw->due;
+	pthread_mutex_unlock(&shim_work_lock);
+	return next;
+}
+
+static void shim_forget_works(void *start, size_t len)
+{
+	struct delayed_work *dw, *next;
+
+	pthread_mutex_lock(&shim_work_lock);
+	for (dw = shim_works; dw; dw = next) {
+		next = dw->next;
+		if ((char *)dw >= (char *)start && (char *)dw < (char *)start + len)
+			shim_unlink_work(dw);
+	}
+	pthread_mutex_unlock(&shim_work_lock);
+}
+
+/* ---- power management ---- */
+
+static struct notifier_block *shim_pm_chain;
+
+int register_pm_notifier(struct notifier_block *nb)
+{
+	nb->next = shim_pm_chain;
+	shim_pm_chain = nb;
+	return 0;
+}
+
+int unregister_pm_notifier(struct notifier_block *nb)
+{
+	struct notifier_block **p;
+
+	for (p = &shim_pm_chain; *p; p = &(*p)->next)
+		if (*p == nb) {
+			*p = nb->next;
+			return 0;
+		}
+	return -ENOENT;
+}
+
+void shim_pm_notify(unsigned long action)
+{
+	struct notifier_block *nb;
+
+	for (nb = shim_pm_chain; nb; nb = nb->next)
+		nb->notifier_call(nb, action, NULL);
+}
+
+/* ---- i2c ---- */
+
+static int shim_adapters;
+
+static void shim_adapter_init(struct i2c_adapter *adap)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+	pthread_mutex_init(&adap->bus_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	adap->nr = shim_adapters++;
+}
+
+int i2c_add_adapter(struct i2c_adapter *adap)
+{
+	shim_adapter_init(adap);
+	return 0;
+}
+
+void i2c_del_adapter(struct i2c_adapter *adap)
+{
+	pthread_mutex_destroy(&adap->bus_lock);
+}
+
+static struct i2c_adapter *shim_root(struct i2c_adapter *adap)
+{
+	while (adap->mux)
+		adap = adap->mux->parent;
+	return adap;
+}
+
+void i2c_lock_bus(struct i2c_adapter *adap, unsigned int flags)
+{
+	if (flags & I2C_LOCK_ROOT_ADAPTER)
+		adap = shim_root(adap);
+	if (pthread_mutex_lock(&adap->bus_lock)) {
+		fprintf(stderr, "shim: adapter %s locked twice\n", adap->name);
+		abort();
+	}
+}
+
+void i2c_unlock_bus(struct i2c_adapter *adap, unsigned int flags)
+{
+	if (flags & I2C_LOCK_ROOT_ADAPTER)
+		adap = shim_root(adap);
+	pthread_mutex_unlock(&adap->bus_lock);
+}
+
+/* mux-locked child: only the child is held while the parent is used */
+int __i2c_transfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	struct i2c_mux_core *muxc = adap->mux;
+	int ret;
+
+	if (!muxc)
+		return adap->algo->master_xfer(adap, msgs, num);
+	ret = muxc->select(muxc, 0);
+	if (ret >= 0)
+		ret = i2c_transfer(muxc->parent, msgs, num);
+	if (muxc->deselect)
+		muxc->deselect(muxc, 0);
+	return ret;
+}
+
+int i2c_transfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	int ret;
+
+	i2c_lock_bus(adap, I2C_LOCK_SEGMENT);
+	ret = __i2c_transfer(adap, msgs, num);
+	i2c_unlock_bus(adap, I2C_LOCK_SEGMENT);
+	return ret;
+}
+
+struct i2c_mux_core *i2c_mux_alloc(struct i2c_adapter *parent, struct device *dev,
+				   int max_adapters, int sizeof_priv, u32 flags,
+				   int (*select)(struct i2c_mux_core *, u32),
+				   int (*deselect)(struct i2c_mux_core *, u32))
+{
+	struct i2c_mux_core *muxc = calloc(1, sizeof(*muxc) + sizeof_priv);
+
+	if (!muxc)
+		return NULL;
+	if (sizeof_priv)
+		muxc->priv = muxc + 1;
+	muxc->parent = parent;
+	muxc->select = select;
+	muxc->deselect = deselect;
+	return muxc;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+int i2c_mux_add_adapter(struct i2c_mux_core *muxc, u32 force_nr, u32 chan_id)
+#else
+int i2c_mux_add_adapter(struct i2c_mux_core *muxc, u32 force_nr, u32 chan_id,
+			unsigned int class)
+#endif
+{
+	struct i2c_adapter *adap;
+
+	if (muxc->num_adapters)
+		return -EINVAL;
+	adap = calloc(1, sizeof(*adap));
+	if (!adap)
+		return -ENOMEM;
+	shim_adapter_init(adap);
+	adap->mux = muxc;
+	snprintf(adap->name, sizeof(adap->name), "i2c-%d-mux (chan_id %u)",
+		 muxc->parent->nr, chan_id);
+	muxc->adapter[muxc->num_adapters++] = adap;
+	return 0;
+}
+
+void i2c_mux_del_adapters(struct i2c_mux_core *muxc)
+{
+	while (muxc->num_adapters) {
+		struct i2c_adapter *adap = muxc->adapter[--muxc->num_adapters];
+
+		pthread_mutex_destroy(&adap->bus_lock);
+		free(adap);
+	}
+}
+
+/* ---- debugfs and seq_file ---- */
+
+struct dentry {
+	char name[64];
+	struct dentry *parent;
+	void *data;
+	const struct file_operations *fops;
+	struct dentry *next;
+};
+
+static struct dentry *shim_dentries;
+
+static struct dentry *shim_dentry(const char *name, struct dentry *parent)
+{
+	struct dentry *d = calloc(1, sizeof(*d));
+
+	strscpy(d->name, name, sizeof(d->name));
+	d->parent = parent;
+	d->next = shim_dentries;
+	shim_dentries = d;
+	return d;
+}
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+	return shim_dentry(name, parent);
+}
+
+struct dentry *debugfs_create_file(const char *name, umode_t mode, struct dentry *parent,
+				   void *data, const struct file_operations *fops)
+{
+	struct dentry *d = shim_dentry(name, parent);
+
+	d->data = data;
+	d->fops = fops;
+	return d;
+}
+
+void debugfs_create_u32(const char *name, umode_t mode, struct dentry *parent, u32 *value)
+{
+}
+
+void debugfs_create_u64(const char *name, umode_t mode, struct dentry *parent, u64 *value)
+{
+}
+
+void debugfs_create_bool(const char *name, umode_t mode, struct dentry *parent, bool *value)
+{
+}
+
+void debugfs_remove_recursive(struct dentry *dentry)
+{
+	struct dentry **p = &shim_dentries, *d;
+
+	if (!dentry)
+		return;
+	while ((d = *p)) {
+		if (d == dentry || d->parent == dentry) {
+			*p = d->next;
+			free(d);
+		} else {
+			p = &d->next;
+		}
+	}
+}
+
+#define SHIM_SEQ_SIZE	(256 * 1024)
+
+int seq_printf(struct seq_file *s, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(s->buf + s->count, s->size - s->count, fmt, ap);
+	va_end(ap);
+	if (len > 0)
+		s->count = min(s->count + len, s->size - 1);
+	return 0;
+}
+
+void seq_puts(struct seq_file *s, const char *str)
+{
+	seq_printf(s, "%s", str);
+}
+
+void seq_putc(struct seq_file *s, char c)
+{
+	seq_printf(s, "%c", c);
+}
+
+int seq_write(struct seq_file *s, const void *data, size_t len)
+{
+	len = min(len, s->size - 1 - s->count);
+	memcpy(s->buf + s->count, data, len);
+	s->count += len;
+	return 0;
+}
+
+int single_open(struct file *file, int (*show)(struct seq_file *, void *), void *data)
+{
+	struct seq_file *s = calloc(1, sizeof(*s));
+
+	if (!s)
+		return -ENOMEM;
+	s->buf = malloc(SHIM_SEQ_SIZE);
+	s->size = SHIM_SEQ_SIZE;
+	s->private = data;
+	s->show = show;
+	file->private_data = s;
+	return 0;
+}
+
+int single_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *s = file->private_data;
+
+	free(s->buf);
+	free(s);
+	return 0;
+}
+
+ssize_t seq_read(struct file *file, char *buf, size_t len, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	int ret;
+
+	if (!*ppos) {
+		s->count = 0;
+		ret = s->show(s, s->private);
+		if (ret)
+			return ret;
+	}
+	return simple_read_from_buffer(buf, len, ppos, s->buf, s->count);
+}
+
+loff_t seq_lseek(struct file *file, loff_t off, int whence)
+{
+	return off;
+}
+
+int simple_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+loff_t no_llseek(struct file *file, loff_t off, int whence)
+{
+	return -ESPIPE;
+}
+
+/* newest file of that name, the last attached device */
+static struct dentry *shim_debugfs_find(const char *name)
+{
+	struct dentry *d;
+
+	for (d = shim_dentries; d; d = d->next)
+		if (d->fops && !strcmp(d->name, name))
+			return d;
+	return NULL;
+}
+
+int shim_debugfs_read(const char *name, char *buf, size_t size)
+{
+	struct dentry *d = shim_debugfs_find(name);
+	struct inode inode;
+	struct file file = { 0 };
+	loff_t pos = 0;
+	size_t used = 0;
+	ssize_t n;
+	int ret;
+
+	if (!d || !d->fops->read || !size)
+		return -ENOENT;
+	inode.i_private = d->data;
+	ret = d->fops->open ? d->fops->open(&inode, &file) : simple_open(&inode, &file);
+	if (ret)
+		return ret;
+	while (used < size - 1) {
+		n = d->fops->read(&file, buf + used, size - 1 - used, &pos);
+		if (n <= 0) {
+			ret = n;
+			break;
+		}
+		used += n;
+	}
+	buf[used] = 0;
+	if (d->fops->release)
+		d->fops->release(&inode, &file);
+	return ret < 0 ? ret : (int)used;
+}
+
+int shim_debugfs_write(const char *name, const char *buf)
+{
+	return shim_debugfs_write_buf(name, buf, strlen(buf));
+}
+
+int shim_debugfs_write_buf(const char *name, const void *buf, size_t len)
+{
+	struct dentry *d = shim_debugfs_find(name);
+	struct inode inode;
+	struct file file = { 0 };
+	loff_t pos = 0;
+	ssize_t n;
+	int ret;
+
+	if (!d || !d->fops->write)
+		return -ENOENT;
+	inode.i_private = d->data;
+	ret = d->fops->open ? d->fops->open(&inode, &file) : simple_open(&inode, &file);
+	if (ret)
+		return ret;
+	n = d->fops->write(&file, buf, len, &pos);
+	if (d->fops->release)
+		d->fops->release(&inode, &file);
+	return n < 0 ? n : 0;
+}
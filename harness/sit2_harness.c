@@ -0,0 +1,299 @@
+/*
+ * sit2 userspace harness: runs the unmodified driver against the protocol
+ * simulator on a virtual clock.
+ *
+ *   sit2_harness bench [cycles]	init, tune and statistics cycles
+ *   sit2_harness kunit			the KUnit suite built into sit2.c
+ *   sit2_harness replay		capture a session, replay it twice on the
+ *					real clock and compare what the driver did
+ *   sit2_harness stress [options]	concurrent frontend calls, see stress.c
+ *
+ * Every run with the virtual clock is deterministic: the same binary and
+ * arguments give the same bus traffic and the same reported times.
+ */
+#include <sit2_shim.h>
+#include "dvb_frontend.h"
+#include "sit2.h"
+#include "../sit2_sim.h"
+#include "harness.h"
+
+extern int sit2_debug;
+
+static const struct sit2_config harness_config = {
+	.ts_bus_mode = 2,
+	.ts_clock_mode = 0,
+};
+
+/* the line-up the bench and the stress runs tune through */
+static const struct sit2_sim_mux harness_muxes[] = {
+	{
+		.delivery_system = SYS_DVBT, .frequency = 474000000,
+		.bandwidth_hz = 8000000, .modulation = QAM_64,
+		.transmission_mode = TRANSMISSION_MODE_8K,
+		.guard_interval = GUARD_INTERVAL_1_4, .code_rate = FEC_2_3,
+		.rssi = -55, .cnr = 280, .ber = 2000, .ucb_per_s = 0,
+	},
+	{
+		.delivery_system = SYS_DVBT2, .frequency = 522000000,
+		.bandwidth_hz = 8000000, .modulation = QAM_256,
+		.transmission_mode = TRANSMISSION_MODE_32K,
+		.guard_interval = GUARD_INTERVAL_1_128, .code_rate = FEC_3_5,
+		.num_plp = 2, .rssi = -60, .cnr = 250, .ber = 500,
+	},
+	{
+		.delivery_system = SYS_DVBC_ANNEX_A, .frequency = 346000000,
+		.symbol_rate = 6900000, .modulation = QAM_256,
+		.rssi = -48, .cnr = 360, .ber = 100,
+	},
+};
+
+int harness_setup(struct harness *h)
+{
+	unsigned int i;
+
+	memset(h, 0, sizeof(*h));
+	h->sim = sit2_sim_create();
+	if (!h->sim)
+		return -ENOMEM;
+	for (i = 0; i < ARRAY_SIZE(harness_muxes); i++)
+		sit2_sim_add_mux(h->sim, &harness_muxes[i]);
+	h->fe = sit2_attach(&harness_config, &h->sim->adap);
+	if (!h->fe) {
+		sit2_sim_destroy(h->sim);
+		return -ENODEV;
+	}
+	return 0;
+}
+
+void harness_teardown(struct harness *h)
+{
+	h->fe->ops.release(h->fe);
+	sit2_sim_destroy(h->sim);
+}
+
+/* fill the property cache as dvb-core would for a tune request */
+void harness_tune_props(struct dvb_frontend *fe, const struct sit2_sim_mux *m)
+{
+	struct dtv_frontend_properties *c = &fe->dtv_property_cache;
+
+	memset(c, 0, sizeof(*c));
+	c->delivery_system = m->delivery_system;
+	c->frequency = m->frequency;
+	c->inversion = INVERSION_AUTO;
+	c->stream_id = NO_STREAM_ID_FILTER;
+	if (m->delivery_system == SYS_DVBC_ANNEX_A) {
+		c->symbol_rate = m->symbol_rate;
+		c->modulation = m->modulation;
+		c->fec_inner = FEC_AUTO;
+	} else {
+		c->bandwidth_hz = m->bandwidth_hz;
+		c->modulation = QAM_AUTO;
+		c->transmission_mode = TRANSMISSION_MODE_AUTO;
+		c->guard_interval = GUARD_INTERVAL_AUTO;
+		c->hierarchy = HIERARCHY_AUTO;
+		c->code_rate_HP = FEC_AUTO;
+		c->code_rate_LP = FEC_AUTO;
+	}
+}
+
+/* one tune the way the dvb-core thread drives a DVBFE_ALGO_HW frontend */
+fe_status_t harness_tune(struct harness *h, const struct sit2_sim_mux *m)
+{
+	unsigned int delay = 0;
+	fe_status_t status = 0;
+
+	harness_tune_props(h->fe, m);
+	h->fe->ops.tune(h->fe, true, 0, &delay, &status);
+	return status;
+}
+
+const struct sit2_sim_mux *harness_mux(unsigned int i)
+{
+	return i < ARRAY_SIZE(harness_muxes) ? &harness_muxes[i] : NULL;
+}
+
+unsigned int harness_num_mux(void)
+{
+	return ARRAY_SIZE(harness_muxes);
+}
+
+/* let the virtual clock run, with the delayed works firing on time */
+void harness_idle(u32 ms)
+{
+	ktime_t end = ktime_add_ms(ktime_get(), ms);
+	ktime_t next;
+
+	for (;;) {
+		shim_run_works();
+		next = shim_next_work();
+		if (next >= end)
+			break;
+		if (next > ktime_get())
+			shim_advance_us(ktime_us_delta(next, ktime_get()));
+	}
+	if (end > ktime_get())
+		shim_advance_us(ktime_us_delta(end, ktime_get()));
+}
+
+void harness_print_debugfs(const char *name)
+{
+	static char buf[256 * 1024];
+
+	if (shim_debugfs_read(name, buf, sizeof(buf)) >= 0)
+		printf("--- %s\n%s", name, buf);
+}
+
+static void harness_print_sim(struct sit2_sim *sim)
+{
+	printf("--- simulator\n");
+	printf("xfers: %llu bytes: %llu bus_us: %llu\n", sim->stats.xfers,
+	       sim->stats.bytes, sim->stats.bus_us);
+	printf("naks: %u violations: %u rejects: %u\n", sim->stats.naks,
+	       sim->stats.violations, sim->stats.rejects);
+	printf("patch_lines: %u restarts: %u tunes: %u\n", sim->stats.patch_lines,
+	       sim->stats.restarts, sim->stats.tunes);
+}
+
+static int harness_bench(int cycles)
+{
+	struct harness h;
+	fe_status_t status;
+	u32 ber, ucb;
+	u16 snr, str;
+	ktime_t start;
+	int i, j, locked = 0, tunes = 0;
+
+	if (harness_setup(&h))
+		return 1;
+	start = ktime_get();
+	h.fe->ops.init(h.fe);
+	for (i = 0; i < cycles; i++) {
+		for (j = 0; j < (int)harness_num_mux(); j++) {
+			status = harness_tune(&h, harness_mux(j));
+			tunes++;
+			if (status & FE_HAS_LOCK)
+				locked++;
+			harness_idle(2000);
+			h.fe->ops.read_status(h.fe, &status);
+			h.fe->ops.read_ber(h.fe, &ber);
+			h.fe->ops.read_ucblocks(h.fe, &ucb);
+			h.fe->ops.read_snr(h.fe, &snr);
+			h.fe->ops.read_signal_strength(h.fe, &str);
+			h.fe->ops.get_frontend(h.fe);
+		}
+		h.fe->ops.sleep(h.fe);
+		harness_idle(10000);
+		h.fe->ops.init(h.fe);
+	}
+	printf("tunes: %d locked: %d virtual_ms: %lld\n", tunes, locked,
+	       ktime_ms_delta(ktime_get(), start));
+	harness_print_debugfs("latency");
+	harness_print_debugfs("fw");
+	harness_print_debugfs("stats");
+	harness_print_sim(h.sim);
+	harness_teardown(&h);
+	return locked == tunes ? 0 : 1;
+}
+
+/* what the replay check runs, captured once and then replayed */
+static void harness_session(struct harness *h)
+{
+	fe_status_t status;
+	unsigned int i;
+	int j;
+
+	h->fe->ops.init(h->fe);
+	for (i = 0; i < harness_num_mux(); i++) {
+		harness_tune(h, harness_mux(i));
+		/* no delayed works: they run on host time, not driver time */
+		for (j = 0; j < 5; j++)
+			h->fe->ops.read_status(h->fe, &status);
+	}
+}
+
+static char harness_cap[1024 * 1024];
+
+static int harness_replay_once(int len, char *out, size_t size)
+{
+	struct harness h;
+	size_t used = 0;
+	const char * const files[] = { "capture_ctl", "latency", "watchdog", "stats", "lock_model" };
+	unsigned int i;
+	int n;
+
+	if (harness_setup(&h))
+		return -1;
+	if (shim_debugfs_write_buf("replay", harness_cap, len) ||
+	    shim_debugfs_write("capture_ctl", "replay")) {
+		harness_teardown(&h);
+		return -1;
+	}
+	harness_session(&h);
+	for (i = 0; i < ARRAY_SIZE(files); i++) {
+		n = shim_debugfs_read(files[i], out + used, size - used);
+		if (n > 0)
+			used += n;
+	}
+	harness_teardown(&h);
+	return h.sim->stats.xfers ? -1 : 0;
+}
+
+static int harness_replay(void)
+{
+	static char first[64 * 1024], second[64 * 1024], ctl[1024];
+	struct harness h;
+	int len;
+
+	if (harness_setup(&h))
+		return 1;
+	shim_debugfs_write("capture_ctl", "capture");
+	harness_session(&h);
+	shim_debugfs_write("capture_ctl", "stop");
+	shim_debugfs_read("capture_ctl", ctl, sizeof(ctl));
+	len = shim_debugfs_read("capture", harness_cap, sizeof(harness_cap));
+	harness_teardown(&h);
+	if ((len <= 0) || !strstr(ctl, "drops: 0\n")) {
+		printf("capture failed:\n%s", ctl);
+		return 1;
+	}
+	printf("captured %d bytes\n", len);
+
+	/* real time passes now, the driver must not notice */
+	shim_clock_mode = SHIM_CLOCK_SCALED;
+	if (harness_replay_once(len, first, sizeof(first)) ||
+	    harness_replay_once(len, second, sizeof(second))) {
+		printf("replay touched the bus or failed\n");
+		return 1;
+	}
+	printf("%s", first);
+	if (!strstr(first, "replay_mismatch: 0\n")) {
+		printf("replay diverged from the capture\n");
+		return 1;
+	}
+	if (strcmp(first, second)) {
+		printf("replays differ:\n%s", second);
+		return 1;
+	}
+	printf("replays identical\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *mode = argc > 1 ? argv[1] : "bench";
+
+	shim_quiet = !getenv("SIT2_HARNESS_VERBOSE");
+	if (getenv("SIT2_DEBUG"))
+		sit2_debug = atoi(getenv("SIT2_DEBUG"));
+	if (!strcmp(mode, "bench"))
+		return harness_bench(argc > 2 ? atoi(argv[2]) : 3);
+	if (!strcmp(mode, "kunit"))
+		return kunit_run_all();
+	if (!strcmp(mode, "replay"))
+		return harness_replay();
+	if (!strcmp(mode, "stress"))
+		return harness_stress(argc - 1, argv + 1);
+	fprintf(stderr, "usage: %s bench [cycles] | kunit | replay | stress [seconds] [readers] [scale]\n",
+		argv[0]);
+	return 2;
+}
@@ -0,0 +1,207 @@
+/*
+ * Concurrency stress: frontend calls from several threads at once, the
+ * way dvb-core's frontend thread, FE_GET_PROPERTY and the stats readers
+ * meet in the driver. Runs on the scaled clock, so the driver's sleeps
+ * are real but shortened.
+ *
+ *   sit2_harness stress [seconds] [readers] [scale]
+ *
+ * One thread retunes through the line-up, the readers loop read_status
+ * and the statistics calls, as many threads loop get_frontend, and one
+ * more runs the delayed works. Latencies are caller side in driver time
+ * and include waiting for the state lock.
+ */
+#include <sit2_shim.h>
+#include <time.h>
+#include "dvb_frontend.h"
+#include "../sit2_sim.h"
+#include "harness.h"
+
+enum stress_op {
+	STRESS_SET_FRONTEND,
+	STRESS_READ_STATUS,
+	STRESS_READ_STATS,
+	STRESS_GET_FRONTEND,
+	STRESS_OP_NUM
+};
+
+static const char * const stress_op_name[STRESS_OP_NUM] = {
+	"set_frontend", "read_status", "read_stats", "get_frontend",
+};
+
+#define STRESS_SAMPLES	(1 << 20)
+
+struct stress_lat {
+	u32 *us;
+	u32 num;
+	u64 lost;
+};
+
+static struct stress_lat stress_lat[STRESS_OP_NUM];
+static pthread_mutex_t stress_lat_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct harness stress_h;
+static volatile bool stress_stop;
+
+static void stress_record(enum stress_op op, ktime_t start)
+{
+	struct stress_lat *l = &stress_lat[op];
+	u32 us = ktime_us_delta(ktime_get(), start);
+
+	pthread_mutex_lock(&stress_lat_lock);
+	if (l->num < STRESS_SAMPLES)
+		l->us[l->num++] = us;
+	else
+		l->lost++;
+	pthread_mutex_unlock(&stress_lat_lock);
+}
+
+static void *stress_tuner(void *arg)
+{
+	struct dvb_frontend *fe = stress_h.fe;
+	unsigned int seed = 1, i = 0, delay;
+	fe_status_t status;
+	ktime_t start;
+
+	while (!stress_stop) {
+		start = ktime_get();
+		harness_tune_props(fe, harness_mux(i++ % harness_num_mux()));
+		fe->ops.tune(fe, true, 0, &delay, &status);
+		stress_record(STRESS_SET_FRONTEND, start);
+		msleep(200 + rand_r(&seed) % 800);
+	}
+	return NULL;
+}
+
+static void *stress_reader(void *arg)
+{
+	struct dvb_frontend *fe = stress_h.fe;
+	fe_status_t status;
+	u32 ber, ucb;
+	u16 snr, str;
+	ktime_t start;
+
+	while (!stress_stop) {
+		start = ktime_get();
+		fe->ops.read_status(fe, &status);
+		stress_record(STRESS_READ_STATUS, start);
+		start = ktime_get();
+		fe->ops.read_signal_strength(fe, &str);
+		fe->ops.read_snr(fe, &snr);
+		fe->ops.read_ber(fe, &ber);
+		fe->ops.read_ucblocks(fe, &ucb);
+		stress_record(STRESS_READ_STATS, start);
+		msleep(20);
+	}
+	return NULL;
+}
+
+static void *stress_getter(void *arg)
+{
+	struct dvb_frontend *fe = stress_h.fe;
+	ktime_t start;
+
+	while (!stress_stop) {
+		start = ktime_get();
+		fe->ops.get_frontend(fe);
+		stress_record(STRESS_GET_FRONTEND, start);
+		msleep(10);
+	}
+	return NULL;
+}
+
+static void *stress_works(void *arg)
+{
+	struct timespec ts = { .tv_nsec = 200000 };
+
+	while (!stress_stop) {
+		shim_run_works();
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+
+static int stress_cmp(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return (x > y) - (x < y);
+}
+
+static u32 stress_pct(const struct stress_lat *l, unsigned int pct)
+{
+	return l->num ? l->us[min_t(u32, (u64)l->num * pct / 100, l->num - 1)] : 0;
+}
+
+static void stress_report(void)
+{
+	struct stress_lat *l;
+	int i;
+
+	printf("%-14s %8s %10s %10s %10s %10s\n", "op", "calls",
+	       "p50_us", "p90_us", "p99_us", "max_us");
+	for (i = 0; i < STRESS_OP_NUM; i++) {
+		l = &stress_lat[i];
+		qsort(l->us, l->num, sizeof(*l->us), stress_cmp);
+		printf("%-14s %8u %10u %10u %10u %10u\n", stress_op_name[i], l->num,
+		       stress_pct(l, 50), stress_pct(l, 90), stress_pct(l, 99),
+		       stress_pct(l, 100));
+		if (l->lost)
+			printf("  %llu samples not kept\n", l->lost);
+	}
+}
+
+int harness_stress(int argc, char **argv)
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : 5;
+	int readers = argc > 2 ? atoi(argv[2]) : 2;
+	pthread_t tuner, works, threads[2 * 16];
+	struct timespec run;
+	ktime_t start;
+	int i, n = 0, ret = 0;
+
+	if (argc > 3)
+		shim_scale = max(atoi(argv[3]), 1);
+	else
+		shim_scale = 10;
+	readers = clamp(readers, 1, 16);
+	for (i = 0; i < STRESS_OP_NUM; i++)
+		stress_lat[i].us = calloc(STRESS_SAMPLES, sizeof(u32));
+
+	if (harness_setup(&stress_h))
+		return 1;
+	/* bring the chip up on the virtual clock, then let real time run */
+	stress_h.fe->ops.init(stress_h.fe);
+	shim_debugfs_write("bus", "0");
+	shim_clock_mode = SHIM_CLOCK_SCALED;
+	start = ktime_get();
+
+	pthread_create(&works, NULL, stress_works, NULL);
+	pthread_create(&tuner, NULL, stress_tuner, NULL);
+	for (i = 0; i < readers; i++) {
+		pthread_create(&threads[n++], NULL, stress_reader, NULL);
+		pthread_create(&threads[n++], NULL, stress_getter, NULL);
+	}
+	run.tv_sec = seconds;
+	run.tv_nsec = 0;
+	nanosleep(&run, NULL);
+	stress_stop = true;
+	pthread_join(tuner, NULL);
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+	pthread_join(works, NULL);
+
+	printf("threads: %d scale: %u driver_ms: %lld\n", n + 2, shim_scale,
+	       ktime_ms_delta(ktime_get(), start));
+	stress_report();
+	harness_print_debugfs("bus");
+	printf("--- simulator\n");
+	printf("xfers: %llu bytes: %llu naks: %u violations: %u\n",
+	       stress_h.sim->stats.xfers, stress_h.sim->stats.bytes,
+	       stress_h.sim->stats.naks, stress_h.sim->stats.violations);
+	if (stress_h.sim->stats.violations || !stress_lat[STRESS_SET_FRONTEND].num)
+		ret = 1;
+	harness_teardown(&stress_h);
+	for (i = 0; i < STRESS_OP_NUM; i++)
+		free(stress_lat[i].us);
+	return ret;
+}
@@ -24,11 +24,44 @@
 #include <linux/module.h>
 #include <linux/string.h>
 #include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/suspend.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/crc32.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+#include <linux/cache.h>
+#include <linux/atomic.h>
+#include <linux/sched.h>
+#include <linux/version.h>
 #include <asm/div64.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 7, 0)
+#define SIT2_I2C_MUX
+#include <linux/i2c-mux.h>
+#endif
 #include "dvb_frontend.h"
 #include "sit2_priv.h"
 #include "sit2.h"
 
+#ifndef DEFINE_SHOW_ATTRIBUTE
+/* seq_file helper from 4.16, open-coded for older media_build trees */
+#define DEFINE_SHOW_ATTRIBUTE(__name)					\
+static int __name ## _open(struct inode *inode, struct file *file)	\
+{									\
+	return single_open(file, __name ## _show, inode->i_private);	\
+}									\
+									\
+static const struct file_operations __name ## _fops = {		\
+	.owner		= THIS_MODULE,					\
+	.open		= __name ## _open,				\
+	.read		= seq_read,					\
+	.llseek		= seq_lseek,					\
+	.release	= single_release,				\
+}
+#endif
+
 int sit2_debug = 0;
 module_param(sit2_debug, int, 0644);
 MODULE_PARM_DESC(sit2_debug, "Activates frontend debugging (default:0)");
@@ -38,6 +71,238 @@ MODULE_PARM_DESC(sit2_debug, "Activates frontend debugging (default:0)");
 			printk(KERN_INFO "sit2: " args); \
 	} while (0)
 
+static int sit2_autosuspend_ms = 5000;
+module_param(sit2_autosuspend_ms, int, 0644);
+MODULE_PARM_DESC(sit2_autosuspend_ms, "Idle time before the frontend is powered down, in ms (default:5000, 0:at once)");
+
+static int sit2_fw_verify = 1;
+module_param(sit2_fw_verify, int, 0644);
+MODULE_PARM_DESC(sit2_fw_verify, "Check the running demod firmware on init and only reload it when lost (default:1)");
+
+static int sit2_retry_max = 2;
+module_param(sit2_retry_max, int, 0644);
+MODULE_PARM_DESC(sit2_retry_max, "Retries for idempotent commands after a bus error or timeout (default:2)");
+
+static int sit2_recover_ms = 2000;
+module_param(sit2_recover_ms, int, 0644);
+MODULE_PARM_DESC(sit2_recover_ms, "Time errors have to persist before recovery escalates past a demod restart, in ms (default:2000)");
+
+static int sit2_stats_ms = 500;
+module_param(sit2_stats_ms, int, 0644);
+MODULE_PARM_DESC(sit2_stats_ms, "Minimum interval between signal statistics refreshes, in ms (default:500)");
+
+static int sit2_ber_window = 5;
+module_param(sit2_ber_window, int, 0644);
+MODULE_PARM_DESC(sit2_ber_window, "BER measurement window, 10^n bits, applied on the next statistics refresh (default:5, 1..9)");
+
+static int sit2_ucb_window = 100;
+module_param(sit2_ucb_window, int, 0644);
+MODULE_PARM_DESC(sit2_ucb_window, "Uncorrectable packet measurement window in packets, applied on init (default:100)");
+
+static int sit2_ts_adapt = 0;
+module_param(sit2_ts_adapt, int, 0644);
+MODULE_PARM_DESC(sit2_ts_adapt, "Lower the TS clock to the locked bitrate (default:0, 1:continuous clock, 2:gapped clock)");
+
+static int sit2_ts_margin = 20;
+module_param(sit2_ts_margin, int, 0644);
+MODULE_PARM_DESC(sit2_ts_margin, "Headroom of the adapted TS clock over the detected bitrate, in percent (default:20)");
+
+static int sit2_wd_grace_ms = 100;
+module_param(sit2_wd_grace_ms, int, 0644);
+MODULE_PARM_DESC(sit2_wd_grace_ms, "Lock loss tolerated before the watchdog restarts the demod, in ms (default:100, 0:watchdog off)");
+
+static int sit2_wd_restart_ms = 1000;
+module_param(sit2_wd_restart_ms, int, 0644);
+MODULE_PARM_DESC(sit2_wd_restart_ms, "Time a demod restart gets to relock before a full retune, in ms (default:1000)");
+
+/* lock loss watchdog steps, in order */
+enum sit2_wd_stage {
+	SIT2_WD_IDLE = 0,
+	SIT2_WD_GRACE,
+	SIT2_WD_RESTART,
+	SIT2_WD_RETUNE,
+};
+
+#define SIT2_WD_POLL_MS		20
+
+static int sit2_dvbc_nosignal_ms = 100;
+module_param(sit2_dvbc_nosignal_ms, int, 0644);
+MODULE_PARM_DESC(sit2_dvbc_nosignal_ms, "Give up a DVB-C acquisition without carrier after this time, in ms (default:100, 0:wait for the full timeout)");
+
+static int sit2_poll_fast_ms = 50;
+module_param(sit2_poll_fast_ms, int, 0644);
+MODULE_PARM_DESC(sit2_poll_fast_ms, "Status poll interval while acquiring or recovering a lock, in ms (default:50)");
+
+static int sit2_poll_slow_ms = 1000;
+module_param(sit2_poll_slow_ms, int, 0644);
+MODULE_PARM_DESC(sit2_poll_slow_ms, "Status poll interval once the lock is stable, in ms (default:1000)");
+
+static int sit2_poll_stable_ms = 10000;
+module_param(sit2_poll_stable_ms, int, 0644);
+MODULE_PARM_DESC(sit2_poll_stable_ms, "Time a lock has to hold before polling slows down, in ms (default:10000)");
+
+#define SIT2_POLL_DEFAULT_MS	200
+
+static int sit2_lock_learn = 1;
+module_param(sit2_lock_learn, int, 0644);
+MODULE_PARM_DESC(sit2_lock_learn, "Poll for lock earlier after fast locks, wait longer after timeouts (default:1)");
+
+static int sit2_rssi_floor = 0;
+module_param(sit2_rssi_floor, int, 0644);
+MODULE_PARM_DESC(sit2_rssi_floor, "Skip the demod acquisition when the tuner RSSI is below this level, in dBm at the tuner input, so normally negative, e.g. -90 (default:0, 0:always acquire)");
+
+static int sit2_replay_vclock = 1;
+module_param(sit2_replay_vclock, int, 0644);
+MODULE_PARM_DESC(sit2_replay_vclock, "Do not sleep while replaying a capture, advance a virtual clock instead (default:1)");
+
+/*
+ * Upper edges of the tuner RSSI bands. There are no measured corrections
+ * for the reference design, so the chip's reading is used as is and only
+ * the board's own sit2_rssi_offset is added per band.
+ */
+#define SIT2_RSSI_BANDS		4
+
+static const u32 sit2_rssi_band_khz[SIT2_RSSI_BANDS] = {
+	174000,		/* VHF I/II */
+	300000,		/* VHF III */
+	600000,		/* UHF low */
+	UINT_MAX,	/* UHF high */
+};
+
+static int sit2_rssi_offset[SIT2_RSSI_BANDS];
+module_param_array(sit2_rssi_offset, int, NULL, 0644);
+MODULE_PARM_DESC(sit2_rssi_offset, "RSSI correction added per band (VHF-I,VHF-III,UHF-low,UHF-high), in 0.001 dB; the only per-band correction applied (default:0)");
+
+/* escalation steps of the error recovery, in order */
+enum sit2_recover_level {
+	SIT2_RECOVER_NONE = 0,
+	SIT2_RECOVER_DEMOD_RESTART,
+	SIT2_RECOVER_TUNER_INIT,
+	SIT2_RECOVER_WARM_INIT,
+	SIT2_RECOVER_COLD_INIT,
+};
+
+/* frontend operations accounted separately for bus cost */
+enum sit2_op {
+	SIT2_OP_INIT = 0,
+	SIT2_OP_SLEEP,
+	SIT2_OP_TUNE_T,
+	SIT2_OP_TUNE_T2,
+	SIT2_OP_TUNE_C,
+	SIT2_OP_GET_FRONTEND,
+	SIT2_OP_STATUS,
+	SIT2_OP_SNR,
+	SIT2_OP_BER,
+	SIT2_OP_UCB,
+	SIT2_OP_STRENGTH,
+	SIT2_OP_STATS,
+	SIT2_OP_SCAN,
+	SIT2_OP_T2_L1,
+	SIT2_OP_NUM
+};
+
+static const char * const sit2_op_name[SIT2_OP_NUM] = {
+	[SIT2_OP_INIT]		= "init",
+	[SIT2_OP_SLEEP]		= "sleep",
+	[SIT2_OP_TUNE_T]	= "tune_dvbt",
+	[SIT2_OP_TUNE_T2]	= "tune_dvbt2",
+	[SIT2_OP_TUNE_C]	= "tune_dvbc",
+	[SIT2_OP_GET_FRONTEND]	= "get_frontend",
+	[SIT2_OP_STATUS]	= "read_status",
+	[SIT2_OP_SNR]		= "read_snr",
+	[SIT2_OP_BER]		= "read_ber",
+	[SIT2_OP_UCB]		= "read_ucblocks",
+	[SIT2_OP_STRENGTH]	= "read_signal_strength",
+	[SIT2_OP_STATS]		= "stats_work",
+	[SIT2_OP_SCAN]		= "scan",
+	[SIT2_OP_T2_L1]		= "t2_l1",
+};
+
+#define SIT2_LAT_BUCKETS	24	/* log2 of the latency in us */
+
+struct sit2_op_stats {
+	u32 calls;
+	u64 xfers;
+	u64 bytes;
+	u64 time_us;
+	u64 sleep_us;
+	u64 wait_us;		/* blocked on the lock */
+	u32 lat_hist[SIT2_LAT_BUCKETS];	/* wait plus hold, seen by the caller */
+};
+
+/* tuning parameters decoded from the chip, valid while locked */
+struct sit2_fe_params {
+	u8 system;		/* dd_status.modulation */
+	fe_modulation_t modulation;
+	fe_transmit_mode_t transmission_mode;
+	fe_guard_interval_t guard_interval;
+	fe_hierarchy_t hierarchy;
+	fe_code_rate_t code_rate_HP;
+	fe_code_rate_t code_rate_LP;
+	fe_code_rate_t fec_inner;
+	fe_spectral_inversion_t inversion;
+	u32 symbol_rate;
+};
+
+/*
+ * observed lock times per detected standard and FFT mode (T/T2) or QAM (C),
+ * the AUTO slots hold requests that left the mode to the demod
+ */
+struct sit2_lock_stat {
+	u16 samples;
+	u16 avg_ms;		/* running average, 1/8 weight */
+	u16 best_ms;
+	u16 worst_ms;
+	u16 timeouts;
+	u16 extend_ms;		/* added to the static window after timeouts */
+};
+
+#define SIT2_LOCK_MODES		8
+#define SIT2_LOCK_BUCKETS	(3 * SIT2_LOCK_MODES)
+#define SIT2_LOCK_LEARN_MIN	4
+
+/* DVB-C candidates tried when the symbol rate is not given */
+struct sit2_dvbc_cand {
+	u32 symbol_rate;
+	fe_modulation_t modulation;
+};
+
+#define SIT2_DVBC_CANDS		8
+
+static const struct sit2_dvbc_cand sit2_dvbc_cand_default[SIT2_DVBC_CANDS] = {
+	{ 6900000, QAM_256 },
+	{ 6900000, QAM_64 },
+	{ 6875000, QAM_256 },
+	{ 6875000, QAM_64 },
+	{ 6111000, QAM_64 },
+	{ 6952000, QAM_256 },
+	{ 5217000, QAM_256 },
+	{ 5000000, QAM_64 },
+};
+
+/* symbol rates searched for a constellation none of the candidates has */
+static const u32 sit2_dvbc_rates[] = {
+	6900000, 6875000, 6952000, 6111000, 5217000, 5000000,
+};
+
+#define SIT2_FEF_TUNER_FLAG	3
+#define SIT2_T2_PLP_MAX		32
+
+/* one entry of a batched scan, request and result */
+struct sit2_scan_result {
+	u32 frequency;
+	u32 rate;		/* bandwidth or symbol rate */
+	s16 stream;		/* -1: none requested */
+	u8 system;
+	u8 lock;
+	u8 detected;		/* dd_status.modulation */
+	u8 num_plp;
+	u8 cnr;			/* 0.25 dB */
+	u16 lock_ms;
+};
+
+#define SIT2_SCAN_MAX		64
+
 /*global state*/
 struct sit2_state {
 	struct dvb_frontend frontend;
@@ -47,26 +312,356 @@ struct sit2_state {
 	bool  isInited;
 	u8 demod_addr;
 	u8 tuner_addr;
-	u8 sndBuffer[64];
-	u8 revBuffer[64];
+	u8 *sndBuffer;		/* DMA safe, see SIT2_CMDBUF_SIZE */
+	u8 *revBuffer;
+	u8 *gateBuffer;		/* pass-through command, sent from mux select */
 	sit2_tuner_reply tuner_reply;
 	sit2_demod_reply demod_reply;
+	
+	/* last decoded replies */
+	SIT2_DD_STATUS dd_status;
+	SIT2_DVBT_STATUS dvbt_status;
+	SIT2_DVBT2_STATUS dvbt2_status;
+	SIT2_DVBC_STATUS dvbc_status;
+	SIT2_BER ber;
+	SIT2_UNCOR uncor;
+	SIT2_TUNER_STATUS tuner_status;
 
 	fe_delivery_system_t current_system;
 	int plp_id;
 	u32 stream;
 	u32 dvbc_symrate;	
+
+	/* serialises all command sequences on the chip */
+	struct mutex lock;
+	struct dentry *debugfs_dir;
+
+	/* power management */
+	struct delayed_work suspend_work;
+	struct notifier_block pm_nb;
+	bool suspend_pending;	/* sleep requested, chip still powered */
+	bool system_sleeping;	/* system suspend in progress */
+	bool restore_pending;	/* restore pm_system on the next cold init */
+	bool pm_retune;		/* chip was tuned when the system went to sleep */
+	fe_delivery_system_t pm_system;
+	u32 pm_warm_resumes;
+	u32 pm_cold_resumes;
+	u32 pm_suspends;
+	u32 pm_retunes;
+
+	/* running demod firmware, as read back after the last download */
+	bool fw_valid;
+	u8 fw_romid;
+	u32 fw_crc;
+	SIT2_FW_REV fw_rev;
+	u32 fw_verified;
+	u32 fw_reloads;
+	u32 fw_adopts;
+
+	/* error recovery */
+	enum sit2_recover_level recover_level;
+	ktime_t recover_step;	/* when the current level was entered */
+	bool retune_pending;	/* chip was reset under a running tune */
+	u8 last_error;
+	u32 cmd_fails;		/* bus errors and timeouts left after retries */
+	u32 err_i2c;
+	u32 err_timeout;
+	u32 err_cmd;
+	u32 rec_retries;
+	u32 rec_restarts;
+	u32 rec_tuner_inits;
+	u32 rec_warm_inits;
+	u32 rec_cold_inits;
+
+	/* bus accounting of the operation holding the lock */
+	enum sit2_op op;
+	ktime_t op_req;
+	ktime_t op_start;
+	struct sit2_op_stats op_stats[SIT2_OP_NUM];
+	u32 cmd_count[SIT2_CMD_NUM];
+	u32 cmd_errors[SIT2_CMD_NUM];
+
+	/* tuner behind the demod's i2c pass-through */
+	struct i2c_mux_core *muxc;
+	struct i2c_adapter *tuner_i2c;
+	struct mutex gate_lock;	/* gate_open, gateBuffer, gate_ops */
+	struct task_struct *xfer_task;	/* in our own tuner transfer */
+	bool gate_open;
+	int tuner_batch;	/* keep the gate open between transfers */
+	u32 gate_ops;
+
+	/* i2c capture ring and replay source */
+	bool cap_on;
+	u8 *cap_buf;
+	u32 cap_head;
+	u32 cap_tail;
+	u32 cap_used;
+	u32 cap_records;
+	u32 cap_drops;
+	ktime_t cap_start;
+	bool replay_on;
+	u8 *replay_buf;
+	u32 replay_len;
+	u32 replay_pos;
+	u32 replay_mismatch;
+	u64 vclock_us;		/* sleeps skipped during replay */
+	ktime_t vclock_base;	/* monotonic clock when the virtual one started */
+	bool vclock;		/* sleeps only advance vclock_us, for tests */
+	
+	/* signal statistics */
+	ktime_t stats_time;
+	bool rssi_valid;
+	s32 rssi_mdbm;
+	u8 rssi_band;
+	struct delayed_work stats_work;
+	bool stats_running;
+	u8 ber_window;		/* exponent the chip was programmed with */
+	u32 ber_last;		/* bit errors in the last window */
+	u64 ber_errors;
+	u64 ber_bits;
+	u32 ber_windows;
+	u64 ucb_total;
+	bool quality_valid;
+	u8 quality_cnr;		/* 0.25 dB */
+	u16 quality_req;	/* 0.1 dB */
+	s16 quality_margin;	/* 0.1 dB */
+	u8 quality_score;	/* 0..100 */
+	
+	/* TS output */
+	u8 ts_mode;
+	u8 ts_clock;
+	u16 ts_freq;		/* 10 kHz */
+	u16 ts_bit_rate;	/* 10 kbps, at the last adaptation */
+	bool ts_gapped;
+	bool ts_adapted;
+	u32 ts_adapts;
+	
+	/* lock loss watchdog */
+	bool wd_locked;
+	enum sit2_wd_stage wd_stage;
+	ktime_t wd_drop_time;
+	ktime_t wd_stage_time;
+	u32 wd_dropouts;
+	u32 wd_restarts;
+	u32 wd_retunes;
+	u32 wd_restart_relocks;
+	u32 wd_retune_relocks;
+	u32 wd_recover_ms_last;
+	u32 wd_recover_ms_max;
+	
+	u32 dvbc_nosignal_aborts;
+	u32 rssi_floor_checks;
+	u32 rssi_floor_skips;
+	
+	u8 *fw_dma;		/* DMA safe copy of the patch last sent */
+	const u8 *fw_dma_src;
+	
+	bool powered;
+	bool params_valid;
+	struct sit2_fe_params params;
+	u32 params_reads;
+	u32 params_hits;
+	u32 params_freq;
+	struct sit2_lock_stat lock_stat[SIT2_LOCK_BUCKETS];
+	u32 lock_min_ms;
+	u32 lock_max_ms;
+	u32 lock_last_ms;
+	u32 lock_timeouts;
+	struct sit2_dvbc_cand dvbc_cand[SIT2_DVBC_CANDS];	/* most recent lock first */
+	u32 dvbc_auto_runs;
+	u32 dvbc_auto_tries;
+	bool dvbc_probing;	/* sit2_dvbc_auto is trying candidates */
+	u32 dvbc_auto_locks;
+	bool t2_l1_valid;
+	u8 t2_plp_num;
+	SIT2_T2_PLP_INFO t2_plp[SIT2_T2_PLP_MAX];
+	SIT2_T2_TX_ID t2_tx_id;
+	SIT2_T2_FEF t2_fef;
+	u8 t2_fef_arg;		/* FEF tuner flag and polarity the demod runs with */
+	u32 t2_l1_reads;
+	bool poll_locked;
+	bool poll_fast;
+	ktime_t poll_lock_time;
+	u32 poll_ms;
+	struct sit2_scan_result *scan_res;
+	u32 scan_num;
+	u32 scans;
+	u32 scan_stops;
+	bool scanning;
+	atomic_t tune_gen;	/* bumped by every tune, sleep and scan cancel */
 };
 
+/*
+ * Command, response and gate buffers share one kmalloc() block, each in its
+ * own cachelines, so bus drivers can DMA from and to them directly.
+ */
+#define SIT2_CMD_MAX		64
+#define SIT2_CMDBUF_SIZE	ALIGN(SIT2_CMD_MAX, L1_CACHE_BYTES)
+
+#ifdef I2C_M_DMA_SAFE
+#define SIT2_I2C_DMA_SAFE	I2C_M_DMA_SAFE
+#else
+#define SIT2_I2C_DMA_SAFE	0
+#endif
+
+#define SIT2_CAPTURE_SIZE	(64 * 1024)
+#define SIT2_REPLAY_SIZE	(1024 * 1024)
+
+static enum sit2_op sit2_tune_op(fe_delivery_system_t system)
+{
+	switch (system) {
+	case SYS_DVBT2:
+		return SIT2_OP_TUNE_T2;
+	case SYS_DVBC_ANNEX_A:
+		return SIT2_OP_TUNE_C;
+	default:
+		return SIT2_OP_TUNE_T;
+	}
+}
+
+static bool sit2_vclock_on(struct sit2_state *state)
+{
+	return state->vclock || (state->replay_on && sit2_replay_vclock);
+}
+
+/*
+ * Driver time, for every timeout and throttle: the monotonic clock plus
+ * the sleeps skipped while replaying. On the virtual clock only the sleeps
+ * move it, so a replay takes the same decisions on every run.
+ */
+static ktime_t sit2_now(struct sit2_state *state)
+{
+	if (sit2_vclock_on(state))
+		return ktime_add_us(state->vclock_base, state->vclock_us);
+	return ktime_add_us(ktime_get(), state->vclock_us);
+}
+
+static void sit2_lock(struct sit2_state *state, enum sit2_op op)
+{
+	ktime_t req = sit2_now(state);
+	mutex_lock(&state->lock);
+	state->op = op;
+	state->op_req = req;
+	state->op_start = sit2_now(state);
+	state->op_stats[op].calls++;
+	state->op_stats[op].wait_us += ktime_us_delta(state->op_start, req);
+}
+
+static void sit2_unlock(struct sit2_state *state)
+{
+	struct sit2_op_stats *st = &state->op_stats[state->op];
+	ktime_t now = sit2_now(state);
+	st->time_us += ktime_us_delta(now, state->op_start);
+	st->lat_hist[min_t(int, fls64(ktime_us_delta(now, state->op_req)),
+			   SIT2_LAT_BUCKETS - 1)]++;
+	mutex_unlock(&state->lock);
+}
+
+static void sit2_cap_put(struct sit2_state *state, const void *data, u32 len)
+{
+	u32 part = min_t(u32, len, SIT2_CAPTURE_SIZE - state->cap_head);
+	memcpy(state->cap_buf + state->cap_head, data, part);
+	memcpy(state->cap_buf, (const u8 *)data + part, len - part);
+	state->cap_head = (state->cap_head + len) % SIT2_CAPTURE_SIZE;
+	state->cap_used += len;
+}
+
+static void sit2_cap_get(struct sit2_state *state, u32 pos, void *data, u32 len)
+{
+	u32 part = min_t(u32, len, SIT2_CAPTURE_SIZE - pos);
+	memcpy(data, state->cap_buf + pos, part);
+	memcpy((u8 *)data + part, state->cap_buf, len - part);
+}
+
+/* append one transaction, dropping the oldest records when full */
+static void sit2_capture(struct sit2_state *state, struct i2c_msg *msg, int ret)
+{
+	struct sit2_cap_rec rec;
+	u32 old;
+	
+	while (SIT2_CAPTURE_SIZE - state->cap_used < sizeof(rec) + msg->len) {
+		sit2_cap_get(state, state->cap_tail, &rec, sizeof(rec));
+		old = sizeof(rec) + le16_to_cpu(rec.len);
+		state->cap_tail = (state->cap_tail + old) % SIT2_CAPTURE_SIZE;
+		state->cap_used -= old;
+		state->cap_records--;
+		state->cap_drops++;
+	}
+	rec.ts_us = cpu_to_le32((u32)ktime_us_delta(sit2_now(state), state->cap_start));
+	rec.addr = msg->addr;
+	rec.flags = ((msg->flags & I2C_M_RD) ? SIT2_CAP_READ : 0) |
+		    ((ret != 1) ? SIT2_CAP_ERROR : 0);
+	rec.len = cpu_to_le16(msg->len);
+	sit2_cap_put(state, &rec, sizeof(rec));
+	sit2_cap_put(state, msg->buf, msg->len);
+	state->cap_records++;
+}
+
+/* serve a transaction from the loaded capture instead of the bus */
+static int sit2_replay(struct sit2_state *state, struct i2c_msg *msg)
+{
+	struct sit2_cap_rec rec;
+	u8 *data;
+	u16 len;
+	bool rd = (msg->flags & I2C_M_RD) != 0;
+	
+	if (state->replay_pos + sizeof(rec) > state->replay_len)
+		return -EIO;
+	memcpy(&rec, state->replay_buf + state->replay_pos, sizeof(rec));
+	len = le16_to_cpu(rec.len);
+	if (state->replay_pos + sizeof(rec) + len > state->replay_len)
+		return -EIO;
+	data = state->replay_buf + state->replay_pos + sizeof(rec);
+	state->replay_pos += sizeof(rec) + len;
+	/* the bus took as long as it did in the capture */
+	if (sit2_vclock_on(state) && (le32_to_cpu(rec.ts_us) > state->vclock_us))
+		state->vclock_us = le32_to_cpu(rec.ts_us);
+	
+	if ((rec.addr != msg->addr) || (((rec.flags & SIT2_CAP_READ) != 0) != rd) ||
+	    (len != msg->len) || (!rd && memcmp(data, msg->buf, len)))
+		state->replay_mismatch++;
+	if (rd)
+		memcpy(msg->buf, data, min_t(u16, len, msg->len));
+	return (rec.flags & SIT2_CAP_ERROR) ? -EIO : 1;
+}
+
+static int sit2_gate_ctrl(struct sit2_state *state, bool open);
+
+/* every bus access of the driver goes through here */
+static int sit2_i2c_xfer(struct sit2_state *state, struct i2c_msg *msg)
+{
+	struct sit2_op_stats *st = &state->op_stats[state->op];
+	bool tuner = state->tuner_i2c && (msg->addr == state->tuner_addr);
+	int ret;
+	st->xfers++;
+	st->bytes += msg->len;
+	if (state->replay_on) {
+		/* do what the mux would, so the stream matches a capture */
+		if (tuner)
+			sit2_gate_ctrl(state, true);
+		ret = sit2_replay(state, msg);
+		if (tuner && !state->tuner_batch)
+			sit2_gate_ctrl(state, false);
+	} else if (tuner) {
+		WRITE_ONCE(state->xfer_task, current);
+		ret = i2c_transfer(state->tuner_i2c, msg, 1);
+		WRITE_ONCE(state->xfer_task, NULL);
+	} else
+		ret = i2c_transfer(state->i2c, msg, 1);
+	if (state->cap_on)
+		sit2_capture(state, msg, ret);
+	return ret;
+}
+
 static u32 sit2_writebytes(struct sit2_state *state, u32 len, u8 *data, bool isTuner)
 {
 	int ret;
 	u32 uret = 0;
-	struct i2c_msg w_msg = { .flags = 0 };
+	struct i2c_msg w_msg = { .flags = SIT2_I2C_DMA_SAFE };
 	w_msg.addr = (isTuner) ? state->tuner_addr : state->demod_addr;;
 	w_msg.buf = data;
 	w_msg.len = len;
-	ret = i2c_transfer(state->i2c, &w_msg, 1);
+	ret = sit2_i2c_xfer(state, &w_msg);
 	if(ret != 1) {
 		printk(KERN_INFO
 	     	"%s: error! addr=%x len=%d, ret=%d\n",
@@ -81,11 +676,11 @@ static u32 sit2_readbytes(struct sit2_state *state, u32 len, u8 *data, bool isTu
 {
 	int ret;
 	u32 uret = 0;
-	struct i2c_msg r_msg = { .flags = I2C_M_RD };
+	struct i2c_msg r_msg = { .flags = I2C_M_RD | SIT2_I2C_DMA_SAFE };
 	r_msg.addr = (isTuner) ? state->tuner_addr : state->demod_addr;
 	r_msg.len = len;
 	r_msg.buf = data;
-	ret = i2c_transfer(state->i2c, &r_msg, 1);
+	ret = sit2_i2c_xfer(state, &r_msg);
 	if(ret != 1) {
 		printk(KERN_INFO
 	     	"%s: error! addr=%x len=%d, ret=%d\n",
@@ -115,14 +710,33 @@ static u8 sit2_demod_ResponseStatus(struct sit2_state *state, u8 Data)
 	return (state->demod_reply.err ? SIT2_ERROR_ERR : SIT2_ERROR_OK);
 }
 
-static u8 sit2_pollForResponse(struct sit2_state *state, u32 nbBytes, u8 *pByteBuffer, bool isTuner)
+#define SIT2_POLL_MS	20	/* CTS poll interval for slow or unknown commands */
+
+/* all waits of the driver go through here */
+static void sit2_msleep(struct sit2_state *state, u32 ms)
+{
+	state->op_stats[state->op].sleep_us += ms * 1000;
+	if (sit2_vclock_on(state))
+		state->vclock_us += ms * 1000;
+	else if (ms < SIT2_POLL_MS)
+		usleep_range(ms * 1000, ms * 1000 + 500);
+	else
+		msleep(ms);
+}
+
+/*
+ * poll for up to a second until the chip reports CTS: every pollMs for the
+ * typical command time, then backing off to SIT2_POLL_MS so that a late
+ * chip is not read a thousand times
+ */
+static u8 sit2_pollForResponse(struct sit2_state *state, u32 nbBytes, u8 *pByteBuffer, bool isTuner, u32 pollMs)
 {
-	u32 ulCount, ulTick, ulDelay;
-	ulCount = 0;
-	ulTick = 50;
-	ulDelay = 1000/ulTick;
+	ktime_t end = ktime_add_ms(sit2_now(state), 1000);
+	u32 ulDelay, ulTyp, ulWaited = 0;
+	ulDelay = clamp_t(u32, pollMs, 1, SIT2_POLL_MS);
+	ulTyp = 2 * ulDelay;
 	
-	while(ulCount <= ulTick) {
+	for (;;) {
 		if (sit2_readbytes(state, nbBytes, pByteBuffer, isTuner) != nbBytes) {
       			dprintk("%s: tuner[%d], readbytes[%d] error!\n", __func__, isTuner, nbBytes);
       			return SIT2_ERROR_POLLING;
@@ -134,68 +748,249 @@ static u8 sit2_pollForResponse(struct sit2_state *state, u32 nbBytes, u8 *pByteB
     			else
       				return sit2_demod_ResponseStatus(state, pByteBuffer[0]);
     		}
-    		msleep(ulDelay);
-    		ulCount++;
+		if (!ktime_before(sit2_now(state), end))
+			break;
+    		sit2_msleep(state, ulDelay);
+		ulWaited += ulDelay;
+		if (ulWaited >= ulTyp)
+			ulDelay = min_t(u32, ulDelay * 2, SIT2_POLL_MS);
   	}
 
   	dprintk("%s: tuner[%d], time out error!\n", __func__, isTuner);
   	return SIT2_ERROR_TIMEOUT;
 }
 
-static u8 sit2_sendCommand(struct sit2_state *state, u32 sndBytes, u32 revBytes, bool isTuner)
+static void sit2_cmd_failed(struct sit2_state *state, u8 err)
+{
+	state->last_error = err;
+	switch (err) {
+	case SIT2_ERROR_I2C:
+	case SIT2_ERROR_POLLING:
+		state->err_i2c++;
+		state->cmd_fails++;
+		break;
+	case SIT2_ERROR_TIMEOUT:
+		state->err_timeout++;
+		state->cmd_fails++;
+		break;
+	default:
+		/* rejected by the chip, resending or resetting will not help */
+		state->err_cmd++;
+		break;
+	}
+}
+
+/* commands that can be sent again without side effects */
+static bool sit2_cmd_idempotent(struct sit2_state *state, const SIT2_CMD_DESC *desc)
+{
+	if (!(desc->flags & SIT2_CMD_F_IDEMPOTENT))
+		return false;
+	/* not when acking interrupts or resetting counters */
+	if ((desc->flags & SIT2_CMD_F_ARG_ACK) && (state->sndBuffer[1] & 0x01))
+		return false;
+	return true;
+}
+
+/* buf has to be DMA safe, it goes to the bus as is */
+static u8 sit2_sendBufferOnce(struct sit2_state *state, u8 *buf, u32 sndBytes, u32 revBytes, bool isTuner, u32 pollMs)
 {
 	u8 uret = SIT2_ERROR_OK;
-	if ((sndBytes > 64) || (revBytes > 64)) {
+	if (revBytes > SIT2_CMD_MAX) {
 		printk(KERN_INFO
 	     	"%s: error! sndBytes=%x revBytes=%d\n",
 	     	__func__, sndBytes, revBytes);
 	     	return SIT2_ERROR_PAREMETER;	
 	}
 	
-	if (sit2_writebytes(state, sndBytes, state->sndBuffer, isTuner) != sndBytes) {
+	if (sit2_writebytes(state, sndBytes, buf, isTuner) != sndBytes) {
 		
 		dprintk("%s: tuner[%d],writebytes[%d] error!\n", __func__, isTuner, sndBytes);
-		return SIT2_ERROR_ERR;
+		return SIT2_ERROR_I2C;
 	}
 	
 	if(revBytes > 0)
-		uret = sit2_pollForResponse(state, revBytes, state->revBuffer, isTuner);
+		uret = sit2_pollForResponse(state, revBytes, state->revBuffer, isTuner, pollMs);
 	return uret;	
 }
 
+static u8 sit2_sendCommandOnce(struct sit2_state *state, u32 sndBytes, u32 revBytes, bool isTuner, u32 pollMs)
+{
+	if (sndBytes > SIT2_CMD_MAX) {
+		printk(KERN_INFO
+	     	"%s: error! sndBytes=%x revBytes=%d\n",
+	     	__func__, sndBytes, revBytes);
+	     	return SIT2_ERROR_PAREMETER;	
+	}
+	return sit2_sendBufferOnce(state, state->sndBuffer, sndBytes, revBytes, isTuner, pollMs);
+}
+
+/*
+ * Generic executor: the caller fills the arguments from sndBuffer[1] on,
+ * lengths, target, retry policy and poll rate come from sit2_cmd_desc.
+ */
+static u8 sit2_execCmd(struct sit2_state *state, enum sit2_cmd cmd)
+{
+	const SIT2_CMD_DESC *desc = &sit2_cmd_desc[cmd];
+	bool isTuner = (desc->flags & SIT2_CMD_F_TUNER) != 0;
+	u8 uret;
+	int retry = 0;
+	
+	state->sndBuffer[0] = desc->opcode;
+	state->cmd_count[cmd]++;
+	if (sit2_debug > 1)
+		printk(KERN_INFO "sit2: %s %*ph\n", desc->name, desc->txLen, state->sndBuffer);
+	for (;;) {
+		uret = sit2_sendCommandOnce(state, desc->txLen, desc->rxLen, isTuner,
+					    max_t(u32, desc->typMs / 2, 1));
+		if ((uret == SIT2_ERROR_OK) || (uret == SIT2_ERROR_PAREMETER))
+			return uret;
+		if ((uret == SIT2_ERROR_ERR) || (retry >= sit2_retry_max) ||
+		    !sit2_cmd_idempotent(state, desc))
+			break;
+		retry++;
+		state->rec_retries++;
+		dprintk("%s: %s error %d, retry %d\n", __func__, desc->name, uret, retry);
+	}
+	state->cmd_errors[cmd]++;
+	sit2_cmd_failed(state, uret);
+	return uret;
+}
+
 static u8 sit2_sendProperty(struct sit2_state *state, u32 prop, u32 data, bool isTuner)
 {
-	state->sndBuffer[0] = 0x14;
 	state->sndBuffer[1] = 0;
 	state->sndBuffer[2] = (u8)(prop & 0xff);
 	state->sndBuffer[3] = (u8)((prop >> 8) & 0xff);
 	state->sndBuffer[4] = (u8)(data & 0xff);
 	state->sndBuffer[5] = (u8)((data >> 8) & 0xff);	
-	return sit2_sendCommand(state, 6, 4, isTuner);
+	return sit2_execCmd(state, isTuner ? SIT2_CMD_TUNER_SET_PROPERTY : SIT2_CMD_SET_PROPERTY);
 }
 
 static u8 sit2_startFirmware(struct sit2_state *state, bool isTuner)
 {
-	state->sndBuffer[0] = 0x01;
 	state->sndBuffer[1] = 1;
-	return sit2_sendCommand(state, 2, 1, isTuner);	
+	return sit2_execCmd(state, isTuner ? SIT2_CMD_TUNER_START_FW : SIT2_CMD_START_FW);
+}
+
+/*
+ * Open or close the tuner pass-through. This runs from the mux select while
+ * sndBuffer holds the tuner message, so it has its own buffer and bypasses
+ * sit2_execCmd(); the command has no reply. Only the driver's own calls,
+ * made with the state lock held, are accounted and captured.
+ */
+static int sit2_gate_switch(struct sit2_state *state, bool open, bool own)
+{
+	struct i2c_msg msg = {
+		.addr = state->demod_addr,
+		.flags = SIT2_I2C_DMA_SAFE,
+		.buf = state->gateBuffer,
+		.len = sit2_cmd_desc[SIT2_CMD_I2C_PASSTHROUGH].txLen,
+	};
+	int ret = 0;
+
+	mutex_lock(&state->gate_lock);
+	if (state->gate_open == open)
+		goto out;
+	state->gateBuffer[0] = sit2_cmd_desc[SIT2_CMD_I2C_PASSTHROUGH].opcode;
+	state->gateBuffer[1] = 13;
+	state->gateBuffer[2] = open ? 1 : 0;
+	if (own) {
+		state->cmd_count[SIT2_CMD_I2C_PASSTHROUGH]++;
+		ret = sit2_i2c_xfer(state, &msg);
+	} else
+		ret = i2c_transfer(state->i2c, &msg, 1);
+	if (ret != 1) {
+		if (own) {
+			state->cmd_errors[SIT2_CMD_I2C_PASSTHROUGH]++;
+			sit2_cmd_failed(state, SIT2_ERROR_I2C);
+		}
+		/* state unknown, send it again next time */
+		state->gate_open = !open;
+		ret = -EIO;
+		goto out;
+	}
+	state->gate_open = open;
+	state->gate_ops++;
+	ret = 0;
+out:
+	mutex_unlock(&state->gate_lock);
+	return ret;
+}
+
+static int sit2_gate_ctrl(struct sit2_state *state, bool open)
+{
+	return sit2_gate_switch(state, open, true);
+}
+
+static void sit2_gate_closed(struct sit2_state *state)
+{
+	mutex_lock(&state->gate_lock);
+	state->gate_open = false;
+	mutex_unlock(&state->gate_lock);
+}
+
+#ifdef SIT2_I2C_MUX
+/*
+ * Other drivers may sit on the tuner adapter too (a second tuner, an
+ * eeprom). Their transfers come in without our state lock, so they only
+ * get the bare gate switch.
+ */
+static int sit2_mux_select(struct i2c_mux_core *muxc, u32 chan)
+{
+	struct sit2_state *state = i2c_mux_priv(muxc);
+	bool own = READ_ONCE(state->xfer_task) == current;
+	return sit2_gate_switch(state, true, own);
+}
+
+static int sit2_mux_deselect(struct i2c_mux_core *muxc, u32 chan)
+{
+	struct sit2_state *state = i2c_mux_priv(muxc);
+	bool own = READ_ONCE(state->xfer_task) == current;
+	/* a batch closes the gate once, when it ends */
+	if (own && state->tuner_batch)
+		return 0;
+	return sit2_gate_switch(state, false, own);
 }
+#endif
 
+/*
+ * With the mux, on/off brackets a batch of tuner transfers: the first one
+ * opens the gate and it stays open until the batch ends.
+ */
 static u8 sit2_demod_tuner_i2c_enable(struct sit2_state *state, u8 onOff)
 {
+	int ret;
 	dprintk("%s, on=%d\n", __func__, onOff);
-	state->sndBuffer[0] = 0xc0;
+#ifdef SIT2_I2C_MUX
+	if (state->tuner_i2c) {
+		if (onOff) {
+			state->tuner_batch++;
+			return SIT2_ERROR_OK;
+		}
+		if (state->tuner_batch && --state->tuner_batch)
+			return SIT2_ERROR_OK;
+		i2c_lock_bus(state->tuner_i2c, I2C_LOCK_SEGMENT);
+		ret = sit2_gate_ctrl(state, false);
+		i2c_unlock_bus(state->tuner_i2c, I2C_LOCK_SEGMENT);
+		return ret ? SIT2_ERROR_I2C : SIT2_ERROR_OK;
+	}
+#endif
 	state->sndBuffer[1] = 13;
 	state->sndBuffer[2] = (onOff > 0) ? 1 : 0;
-	return sit2_sendCommand(state, 3, 0, false);	
+	ret = sit2_execCmd(state, SIT2_CMD_I2C_PASSTHROUGH);
+	if (ret == SIT2_ERROR_OK) {
+		mutex_lock(&state->gate_lock);
+		state->gate_open = onOff > 0;
+		mutex_unlock(&state->gate_lock);
+	}
+	return ret;
 }
 
 static u8 sit2_tuner_xout_enable(struct sit2_state *state, u8 onOff)
 {
-	state->sndBuffer[0] = 0xc0;
 	state->sndBuffer[1] = 0;
 	state->sndBuffer[2] = (onOff > 0) ? (3 << 2) : 0;
-	return sit2_sendCommand(state, 3, 1, true);
+	return sit2_execCmd(state, SIT2_CMD_TUNER_XOUT);
 }
 
 static u8 sit2_tuner_enable_FEF(struct sit2_state *state, u8 fef)
@@ -211,13 +1006,12 @@ static u8 sit2_tuner_enable_FEF(struct sit2_state *state, u8 fef)
 static u8 sit2_tuner_setup_FEFMode(struct sit2_state *state, u8 fef)
 {
 	u8 uret = SIT2_ERROR_OK;
-	state->sndBuffer[0] = 0x12;
 	state->sndBuffer[1] = 1;
 	state->sndBuffer[2] = 1;
 	state->sndBuffer[3] = 1;
 	state->sndBuffer[4] = 1;
 	state->sndBuffer[5] = 1;	
-	uret = sit2_sendCommand(state, 6, 6, true);
+	uret = sit2_execCmd(state, SIT2_CMD_TUNER_CONFIG_PINS);
 	
 	sit2_sendProperty(state, 0x070e, 0, true);	
 	sit2_sendProperty(state, 0x0708, 0, true);
@@ -229,14 +1023,12 @@ static u8 sit2_tuner_setup_FEFMode(struct sit2_state *state, u8 fef)
 
 static u8 sit2_tuner_standby(struct sit2_state *state)
 {
-	state->sndBuffer[0] = 0x16;
 	state->sndBuffer[1] = 0;
-	return sit2_sendCommand(state, 2, 1, true);
+	return sit2_execCmd(state, SIT2_CMD_TUNER_STANDBY);
 }
 
 static u8 sit2_tuner_powerUp(struct sit2_state *state)
 {
-	state->sndBuffer[0] = 0xc0;
 	state->sndBuffer[1] = 0;
 	state->sndBuffer[2] = 0;
 	state->sndBuffer[3] = 0;
@@ -252,22 +1044,36 @@ static u8 sit2_tuner_powerUp(struct sit2_state *state)
 	state->sndBuffer[13] = 0;
 	state->sndBuffer[14] = 1;
 	
-	return sit2_sendCommand(state, 15, 1, true);
+	return sit2_execCmd(state, SIT2_CMD_TUNER_POWER_UP);
 }
 
-static u8 sit2_tuner_getStatus(struct sit2_state *state, u8 intack)
+static u8 sit2_tuner_getStatus(struct sit2_state *state, u8 intack, SIT2_TUNER_STATUS *pStatus)
 {
-	state->sndBuffer[0] = 0x42;
+	u8 uret;
+	u8 *rsp = state->revBuffer;
 	state->sndBuffer[1] = intack & 0x01;
-	return sit2_sendCommand(state, 2, 12, true);
+	uret = sit2_execCmd(state, SIT2_CMD_TUNER_STATUS);
+	if(uret != SIT2_ERROR_OK) {
+		memset(pStatus, 0, sizeof(*pStatus));
+		return uret;
+	}
+	
+	pStatus->tc = rsp[2] & 0x01;
+	pStatus->rssil = (rsp[2] >> 1) & 0x01;
+	pStatus->rssih = (rsp[2] >> 2) & 0x01;
+	pStatus->rssi = (s8)rsp[3];
+	pStatus->freq = (rsp[7] << 24) | (rsp[6] << 16) | (rsp[5] << 8) | rsp[4];
+	pStatus->mode = rsp[8];
+	return uret;
 }
 
 static u8 sit2_tuner_wakeUp(struct sit2_state *state)
 {
-	u8 uret, status = 0;
+	u8 uret;
 	/* check CTS */
-	uret = sit2_pollForResponse(state, 1, &status, true);
-	if((uret == SIT2_ERROR_TIMEOUT) || (status & 0x80) != 0x80) {
+	state->revBuffer[0] = 0;
+	uret = sit2_pollForResponse(state, 1, state->revBuffer, true, SIT2_POLL_MS);
+	if((uret == SIT2_ERROR_TIMEOUT) || (state->revBuffer[0] & 0x80) != 0x80) {
 		printk(KERN_INFO
 	     	"%s: error! tuner is not ready.\n",
 	     	__func__);		
@@ -278,14 +1084,13 @@ static u8 sit2_tuner_wakeUp(struct sit2_state *state)
 
 static u8 sit2_tuner_tuneFreq(struct sit2_state *state, u32 frequency)
 {
-	u8 uret, status;
+	u8 uret;
 	int timeout = 150;
 	u32 ulCount, ulTick, ulDelay;
 	ulCount = 0;
 	ulTick = 3;
 	ulDelay = timeout/ulTick;
 	
-	state->sndBuffer[0] = 0x41;
 	state->sndBuffer[1] = 0;
 	state->sndBuffer[2] = 0;
 	state->sndBuffer[3] = 0;
@@ -295,37 +1100,41 @@ static u8 sit2_tuner_tuneFreq(struct sit2_state *state, u32 frequency)
 	state->sndBuffer[6] = (u8)((frequency >> 16) & 0xff);
 	state->sndBuffer[7] = (u8)((frequency >> 24) & 0xff);
 	
-	uret = sit2_sendCommand(state, 8, 1, true);
+	uret = sit2_execCmd(state, SIT2_CMD_TUNER_TUNE);
 	if(uret != SIT2_ERROR_OK)
 		return uret;
     		
 	while(ulCount <= ulTick) {
-		uret = sit2_pollForResponse(state, 1, &status, true);
+		uret = sit2_pollForResponse(state, 1, state->revBuffer, true, SIT2_POLL_MS);
 		if(uret != SIT2_ERROR_OK)
 			return uret;
 		if(state->tuner_reply.tunint)
 			break;
-		msleep(ulDelay);
+		sit2_msleep(state, ulDelay);
 		ulCount++;		
 	}
-	if(state->tuner_reply.tunint == 0)
+	if(state->tuner_reply.tunint == 0) {
+		sit2_cmd_failed(state, SIT2_ERROR_TIMEOUT);
 		return SIT2_ERROR_TIMEOUT;
+	}
 		
 	timeout = 20;
 	ulCount = 0;
 	ulTick = 2;
 	ulDelay = timeout/ulTick;
 	while ( ulCount <= ulTick ) {
-		uret = sit2_pollForResponse(state, 1, &status, true);
+		uret = sit2_pollForResponse(state, 1, state->revBuffer, true, SIT2_POLL_MS);
 		if(uret != SIT2_ERROR_OK)
 			return uret;
 		if(state->tuner_reply.dtvint)
 			break;
-		msleep(ulDelay);
+		sit2_msleep(state, ulDelay);
 		ulCount++;					
 	}	
-	if(state->tuner_reply.dtvint == 0)
+	if(state->tuner_reply.dtvint == 0) {
+		sit2_cmd_failed(state, SIT2_ERROR_TIMEOUT);
 		return SIT2_ERROR_TIMEOUT;
+	}
 	
 	return SIT2_ERROR_OK;
 }
@@ -355,26 +1164,9 @@ static u8 sit2_tuner_setFreq(struct sit2_state *state, u32 frequency, fe_deliver
 	return uret;
 }
 
-static u8 sit2_tuner_init(struct sit2_state *state)
+/* default tuner properties, lost when the tuner firmware restarts */
+static void sit2_tuner_setup(struct sit2_state *state)
 {
-	u8 uret = SIT2_ERROR_OK;
-		
-	/* wake up */
-	uret = sit2_tuner_wakeUp(state);
-	if(uret != SIT2_ERROR_OK)
-		return uret;
-	/* power up */
-	uret = sit2_tuner_powerUp(state);
-	if(uret != SIT2_ERROR_OK)
-		return uret;
-	/* check part info */
-	/* load firmware */
-	/* start firmare */
-	uret = sit2_startFirmware(state, true);
-	if(uret != SIT2_ERROR_OK)
-		return uret;
-	
-	/* download default properties */
 	/* ATV property */
 	sit2_sendProperty(state, 0x0610, 1000, true); /* afc range*/
 	sit2_sendProperty(state, 0x0611, 0, true); /* agc speed */
@@ -419,7 +1211,28 @@ static u8 sit2_tuner_init(struct sit2_state *state)
 	sit2_sendProperty(state, 0x0505, (1 << 10) | (1 << 9) | (1 << 8), true);
 	sit2_sendProperty(state, 0x0506, 1, true);
 	sit2_sendProperty(state, 0x0507, 127, true);
+}
+
+static u8 sit2_tuner_init(struct sit2_state *state)
+{
+	u8 uret = SIT2_ERROR_OK;
+		
+	/* wake up */
+	uret = sit2_tuner_wakeUp(state);
+	if(uret != SIT2_ERROR_OK)
+		return uret;
+	/* power up */
+	uret = sit2_tuner_powerUp(state);
+	if(uret != SIT2_ERROR_OK)
+		return uret;
+	/* check part info */
+	/* load firmware */
+	/* start firmare */
+	uret = sit2_startFirmware(state, true);
+	if(uret != SIT2_ERROR_OK)
+		return uret;
 	
+	sit2_tuner_setup(state);
 	return uret;
 }
 
@@ -428,7 +1241,6 @@ static u8 sit2_demod_wakeUp(struct sit2_state *state, u8 resetCode, u8 funcCode)
 	u8 uret = SIT2_ERROR_OK;
 	 dprintk("%s, resetCode=%d, funcCode=%d\n", __func__, resetCode, funcCode);
 	 /* start clock */
-	state->sndBuffer[0] = 0xc0;
 	state->sndBuffer[1] = 18;
 	state->sndBuffer[2] = 0;
 	state->sndBuffer[3] = 12;
@@ -441,12 +1253,11 @@ static u8 sit2_demod_wakeUp(struct sit2_state *state, u8 resetCode, u8 funcCode)
 	state->sndBuffer[10] = 0;
 	state->sndBuffer[11] = 0;
 	state->sndBuffer[12] = 0;	
-	uret = sit2_sendCommand(state, 13, 0, false);
+	uret = sit2_execCmd(state, SIT2_CMD_START_CLK);
 	if(uret != SIT2_ERROR_OK)
 		return uret;
 	/* power up */
 	dprintk("%s, power up\n", __func__);
-	state->sndBuffer[0] = 0xc0;
 	state->sndBuffer[1] = 6;
 	state->sndBuffer[2] = resetCode;
 	state->sndBuffer[3] = 15;
@@ -454,7 +1265,9 @@ static u8 sit2_demod_wakeUp(struct sit2_state *state, u8 resetCode, u8 funcCode)
 	state->sndBuffer[5] = (1 << 5);
 	state->sndBuffer[6] = (2 << 4) | (funcCode & 0x0f);
 	state->sndBuffer[7] = 1;
-	uret = sit2_sendCommand(state, 8, 1, false);
+	uret = sit2_execCmd(state, SIT2_CMD_POWER_UP);
+	/* the pass-through comes up closed */
+	sit2_gate_closed(state);
 	dprintk("%s, power up[%d]\n", __func__, uret);
 	return uret;
 }
@@ -463,34 +1276,56 @@ static u8 sit2_demod_powerDown(struct sit2_state *state)
 {
 	u8 uret;
 	dprintk("%s\n", __func__);
-	state->sndBuffer[0] = 0x13;
-	uret = sit2_sendCommand(state, 1, 0, false);
+	uret = sit2_execCmd(state, SIT2_CMD_POWER_DOWN);
+	sit2_gate_closed(state);
 	return uret;
 }
 
 static u8 sit2_demod_reStart(struct sit2_state *state)
 {
 	u8 uret;
-	state->sndBuffer[0] = 0x85;
-	uret = sit2_sendCommand(state, 1, 1, false);
+	uret = sit2_execCmd(state, SIT2_CMD_DD_RESTART);
 	return uret;
 }
 
 static u8 sit2_demod_romId(struct sit2_state *state, u8 *id)
 {
 	u8 uret;
-	state->sndBuffer[0] = 0x02;
-	uret = sit2_sendCommand(state, 1, 13, false);
-	*id = state->revBuffer[12];
+	uret = sit2_execCmd(state, SIT2_CMD_PART_INFO);
+	*id = (uret == SIT2_ERROR_OK) ? state->revBuffer[12] : 0;
+	return uret;
+}
+
+static u8 sit2_demod_getRev(struct sit2_state *state, SIT2_FW_REV *pRev)
+{
+	u8 uret;
+	uret = sit2_execCmd(state, SIT2_CMD_GET_REV);
+	if(uret != SIT2_ERROR_OK) {
+		memset(pRev, 0, sizeof(*pRev));
+		return uret;
+	}
+	
+	pRev->pn = state->revBuffer[1];
+	pRev->fwmajor = state->revBuffer[2];
+	pRev->fwminor = state->revBuffer[3];
+	pRev->patch = (state->revBuffer[5] << 8) | state->revBuffer[4];
+	pRev->cmpmajor = state->revBuffer[6];
+	pRev->cmpminor = state->revBuffer[7];
+	pRev->cmpbuild = state->revBuffer[8];
+	pRev->chiprev = state->revBuffer[9];
+	
 	return uret;
 }
 
 static u8 sit2_demod_getStatus(struct sit2_state *state, u8 intack, SIT2_DD_STATUS *pStatus)
 {
 	u8 uret;
-	state->sndBuffer[0] = 0x87;
 	state->sndBuffer[1] = intack & 0x01;
-	uret = sit2_sendCommand(state, 2, 8, false);
+	uret = sit2_execCmd(state, SIT2_CMD_DD_STATUS);
+	if(uret != SIT2_ERROR_OK) {
+		memset(pStatus, 0, sizeof(*pStatus));
+		return uret;
+	}
 	
 	pStatus->pclint = (state->revBuffer[1] >> 1) & 0x01;
 	pStatus->dlint = (state->revBuffer[1] >> 2) & 0x01;
@@ -515,151 +1350,426 @@ static u8 sit2_demod_getStatus(struct sit2_state *state, u8 intack, SIT2_DD_STAT
 	return uret;
 }
 
-static u8 sit2_demod_getDVBTStatus(struct sit2_state *state, u8 intack)
+static u8 sit2_demod_getDVBTStatus(struct sit2_state *state, u8 intack, SIT2_DVBT_STATUS *pStatus)
 {
 	u8 uret;
-	state->sndBuffer[0] = 0xa0;
+	u8 *rsp = state->revBuffer;
 	state->sndBuffer[1] = intack & 0x01;
-	uret = sit2_sendCommand(state, 2, 13, false);
+	uret = sit2_execCmd(state, SIT2_CMD_DVBT_STATUS);
+	if(uret != SIT2_ERROR_OK) {
+		memset(pStatus, 0, sizeof(*pStatus));
+		return uret;
+	}
+	
+	pStatus->pcl = (rsp[2] >> 1) & 0x01;
+	pStatus->dl = (rsp[2] >> 2) & 0x01;
+	pStatus->ber = (rsp[2] >> 3) & 0x01;
+	pStatus->uncor = (rsp[2] >> 4) & 0x01;
+	pStatus->cnr = rsp[3];
+	pStatus->afc_freq = (s16)((rsp[5] << 8) | rsp[4]);
+	pStatus->timing_offset = (s16)((rsp[7] << 8) | rsp[6]);
+	pStatus->constellation = rsp[8] & 0x3f;
+	pStatus->sp_inv = (rsp[8] >> 6) & 0x01;
+	pStatus->rate_hp = rsp[9] & 0x0f;
+	pStatus->rate_lp = (rsp[9] >> 4) & 0x0f;
+	pStatus->fft_mode = rsp[10] & 0x0f;
+	pStatus->guard_int = (rsp[10] >> 4) & 0x07;
+	pStatus->hierarchy = rsp[11] & 0x07;
 	return uret;
 }
 
-static u8 sit2_demod_getDVBT2Status(struct sit2_state *state, u8 intack)
+static u8 sit2_demod_getDVBT2Status(struct sit2_state *state, u8 intack, SIT2_DVBT2_STATUS *pStatus)
 {
 	u8 uret;
-	state->sndBuffer[0] = 0x50;
+	u8 *rsp = state->revBuffer;
 	state->sndBuffer[1] = intack & 0x01;
-	uret = sit2_sendCommand(state, 2, 14, false);
+	uret = sit2_execCmd(state, SIT2_CMD_DVBT2_STATUS);
+	if(uret != SIT2_ERROR_OK) {
+		memset(pStatus, 0, sizeof(*pStatus));
+		return uret;
+	}
+	
+	pStatus->pcl = (rsp[2] >> 1) & 0x01;
+	pStatus->dl = (rsp[2] >> 2) & 0x01;
+	pStatus->ber = (rsp[2] >> 3) & 0x01;
+	pStatus->uncor = (rsp[2] >> 4) & 0x01;
+	pStatus->cnr = rsp[3];
+	pStatus->afc_freq = (s16)((rsp[5] << 8) | rsp[4]);
+	pStatus->timing_offset = (s16)((rsp[7] << 8) | rsp[6]);
+	pStatus->constellation = rsp[8] & 0x3f;
+	pStatus->sp_inv = (rsp[8] >> 6) & 0x01;
+	pStatus->fft_mode = rsp[9] & 0x0f;
+	pStatus->guard_int = (rsp[9] >> 4) & 0x07;
+	pStatus->num_plp = rsp[10];
+	pStatus->pilot_pattern = rsp[11] & 0x0f;
+	pStatus->rotated = (rsp[11] >> 5) & 0x01;
+	pStatus->code_rate = rsp[12] & 0x0f;
+	pStatus->t2_version = rsp[13] & 0x0f;
 	return uret;
 }
 
-static u8 sit2_demod_getDVBCStatus(struct sit2_state *state, u8 intack)
+static u8 sit2_demod_getDVBCStatus(struct sit2_state *state, u8 intack, SIT2_DVBC_STATUS *pStatus)
 {
 	u8 uret;
-	state->sndBuffer[0] = 0x90;
+	u8 *rsp = state->revBuffer;
 	state->sndBuffer[1] = intack & 0x01;
-	uret = sit2_sendCommand(state, 2, 9, false);
+	uret = sit2_execCmd(state, SIT2_CMD_DVBC_STATUS);
+	if(uret != SIT2_ERROR_OK) {
+		memset(pStatus, 0, sizeof(*pStatus));
+		return uret;
+	}
+	
+	pStatus->pcl = (rsp[2] >> 1) & 0x01;
+	pStatus->dl = (rsp[2] >> 2) & 0x01;
+	pStatus->ber = (rsp[2] >> 3) & 0x01;
+	pStatus->uncor = (rsp[2] >> 4) & 0x01;
+	pStatus->cnr = rsp[3];
+	pStatus->afc_freq = (s16)((rsp[5] << 8) | rsp[4]);
+	pStatus->timing_offset = (s16)((rsp[7] << 8) | rsp[6]);
+	pStatus->constellation = rsp[8] & 0x3f;
+	pStatus->sp_inv = (rsp[8] >> 6) & 0x01;
 	return uret;
 }
 
-static u8 sit2_demod_getUncor(struct sit2_state *state, u8 rstcode)
+static u8 sit2_demod_getUncor(struct sit2_state *state, u8 rstcode, SIT2_UNCOR *pUncor)
 {
 	u8 uret;
-	state->sndBuffer[0] = 0x84;
 	state->sndBuffer[1] = rstcode & 0x01;
-	uret = sit2_sendCommand(state, 2, 3, false);
+	uret = sit2_execCmd(state, SIT2_CMD_DD_UNCOR);
+	pUncor->errors = (uret == SIT2_ERROR_OK) ?
+		((state->revBuffer[2] << 8) | state->revBuffer[1]) : 0;
 	return uret;
 }
 
-static u8 sit2_demod_getBer(struct sit2_state *state, u8 rstcode)
+static u8 sit2_demod_getBer(struct sit2_state *state, u8 rstcode, SIT2_BER *pBer)
 {
 	u8 uret;
-	state->sndBuffer[0] = 0x82;
 	state->sndBuffer[1] = rstcode & 0x01;
-	uret = sit2_sendCommand(state, 2, 3, false);
+	uret = sit2_execCmd(state, SIT2_CMD_DD_BER);
+	pBer->exp = (uret == SIT2_ERROR_OK) ? state->revBuffer[1] : 0;
+	pBer->mant = (uret == SIT2_ERROR_OK) ? state->revBuffer[2] : 0;
+	return uret;
+}
+
+/* read the standard specific status matching dd_status.modulation */
+static u8 sit2_demod_getSystemStatus(struct sit2_state *state, u8 intack, u8 modulation, u8 *cnr)
+{
+	u8 uret = SIT2_ERROR_PAREMETER;
+	*cnr = 0;
+	switch(modulation) {
+	case 2: /*DVB-T*/
+		uret = sit2_demod_getDVBTStatus(state, intack, &state->dvbt_status);
+		*cnr = state->dvbt_status.cnr;
+		break;
+	case 7: /*DVB-T2*/
+		uret = sit2_demod_getDVBT2Status(state, intack, &state->dvbt2_status);
+		*cnr = state->dvbt2_status.cnr;
+		break;
+	case 3: /*DVB-C*/
+		uret = sit2_demod_getDVBCStatus(state, intack, &state->dvbc_status);
+		*cnr = state->dvbc_status.cnr;
+		break;
+	}
 	return uret;
 }
 
+/* the patch lives in module memory, keep one DMA safe copy to send from */
+static u8 *sit2_fw_dma(struct sit2_state *state, const u8 *fw, u32 fwSize)
+{
+	if (state->fw_dma && (state->fw_dma_src == fw))
+		return state->fw_dma;
+	kfree(state->fw_dma);
+	state->fw_dma = kmemdup(fw, fwSize, GFP_KERNEL);
+	state->fw_dma_src = state->fw_dma ? fw : NULL;
+	return state->fw_dma;
+}
+
+static u8 sit2_demod_sendFWLine(struct sit2_state *state, u8 *src, u8 *dma, u32 len)
+{
+	if (dma)
+		return sit2_sendBufferOnce(state, dma, len, 1, false, 1);
+	memcpy(state->sndBuffer, src, len);
+	return sit2_sendCommandOnce(state, len, 1, false, 1);
+}
+
 static u8 sit2_demod_downloadFW(struct sit2_state *state, u8 fw[], u32 fwSize, u8 nbPerLine)
 {
 	u8 uret = SIT2_ERROR_OK;
 	u32 line, fw_lines, line_left;
+	u8 *dma = sit2_fw_dma(state, fw, fwSize);
 	fw_lines = fwSize / nbPerLine;
 	line_left = fwSize - fw_lines*nbPerLine;
 	if(fw_lines > 0) {
 		for(line = 0; line < fw_lines; line++) {
-			memcpy(state->sndBuffer, fw + nbPerLine*line, nbPerLine);
-			uret = sit2_sendCommand(state, nbPerLine, 1, false);
+			uret = sit2_demod_sendFWLine(state, fw + nbPerLine*line,
+						     dma ? dma + nbPerLine*line : NULL, nbPerLine);
 			if(uret != SIT2_ERROR_OK)
 				break;
 		}
 	}
-	if(line_left) {
-		memcpy(state->sndBuffer, fw + nbPerLine*fw_lines, line_left);
-		uret = sit2_sendCommand(state, line_left, 1, false);
+	if(line_left && (uret == SIT2_ERROR_OK)) {
+		uret = sit2_demod_sendFWLine(state, fw + nbPerLine*fw_lines,
+					     dma ? dma + nbPerLine*fw_lines : NULL, line_left);
 	}	
+	if(uret != SIT2_ERROR_OK)
+		sit2_cmd_failed(state, uret);
 	return uret;
 }
 
+static bool sit2_demod_getPatch(u8 romid, u8 **fw, u32 *fwSize)
+{
+	if(romid == 2) { /* Ver20 */
+		*fw = sit2_patch_2;
+		*fwSize = SIT2_PATCH_2_SIZE;
+	} else if (romid == 3) { /* Ver30 */
+		*fw = sit2_patch_3;
+		*fwSize = SIT2_PATCH_3_SIZE;
+	} else
+		return false;
+	return true;
+}
+
+/*
+ * What GET_REV reports once the shipped patch runs. A chip left running by
+ * an earlier load is only adopted if it matches, there is no entry for the
+ * Ver20 patch, so that one is always loaded again.
+ */
+static const SIT2_FW_REV sit2_patch_rev[4] = {
+	[3] = { .patch = 0x0b70, .cmpmajor = '4', .cmpminor = '0', .cmpbuild = 11 },
+};
+
+static bool sit2_demod_isPatchRev(u8 romid, const SIT2_FW_REV *rev)
+{
+	const SIT2_FW_REV *want;
+	
+	if(romid >= ARRAY_SIZE(sit2_patch_rev))
+		return false;
+	want = &sit2_patch_rev[romid];
+	return want->patch && (rev->patch == want->patch) &&
+	       (rev->cmpmajor == want->cmpmajor) &&
+	       (rev->cmpminor == want->cmpminor) &&
+	       (rev->cmpbuild == want->cmpbuild);
+}
+
+/* check that the demod still runs the firmware we started */
+static u8 sit2_demod_checkFW(struct sit2_state *state)
+{
+	u8 uret, romid, *fw;
+	u32 fwSize;
+	SIT2_FW_REV rev;
+	
+	uret = sit2_demod_romId(state, &romid);
+	if(uret != SIT2_ERROR_OK)
+		return uret;
+	uret = sit2_demod_getRev(state, &rev);
+	if(uret != SIT2_ERROR_OK)
+		return uret;
+	dprintk("%s: rom[%d] fw %d.%d patch %04x build %c.%c.%d\n", __func__, romid,
+		rev.fwmajor, rev.fwminor, rev.patch, rev.cmpmajor, rev.cmpminor, rev.cmpbuild);
+	
+	if(state->fw_valid) {
+		if((romid != state->fw_romid) ||
+		   (rev.pn != state->fw_rev.pn) ||
+		   (rev.fwmajor != state->fw_rev.fwmajor) ||
+		   (rev.fwminor != state->fw_rev.fwminor) ||
+		   (rev.patch != state->fw_rev.patch) ||
+		   (rev.cmpbuild != state->fw_rev.cmpbuild))
+			return SIT2_ERROR_ERR;
+		return SIT2_ERROR_OK;
+	}
+	
+	/* after a driver reload only adopt a chip that runs our patch */
+	if(!sit2_demod_getPatch(romid, &fw, &fwSize) || !sit2_demod_isPatchRev(romid, &rev))
+		return SIT2_ERROR_ERR;
+	state->fw_valid = true;
+	state->fw_romid = romid;
+	state->fw_rev = rev;
+	state->fw_crc = crc32_le(~0, fw, fwSize);
+	return SIT2_ERROR_OK;
+}
+
 static u8 sit2_demod_setMP(struct sit2_state *state, u8 mp_a, u8 mp_b, u8 mp_c, u8 mp_d)
 {
-	state->sndBuffer[0] = 0x88;
 	state->sndBuffer[1] = mp_a;
 	state->sndBuffer[2] = mp_b;
 	state->sndBuffer[3] = mp_c;
 	state->sndBuffer[4] = mp_d;
-	return sit2_sendCommand(state, 5, 5, false);
+	return sit2_execCmd(state, SIT2_CMD_DD_MP_DEFAULTS);
 }
 
 static u8 sit2_demod_setGPIO(struct sit2_state *state, u8 gpMode_0, u8 gpRead_0, u8 gpMode_1, u8 gpRead_1)
 {
-	state->sndBuffer[0] = 0x12;
 	state->sndBuffer[1] = (gpRead_0 << 7) | gpMode_0;
 	state->sndBuffer[2] = (gpRead_1 << 7) | gpMode_1;
-	return sit2_sendCommand(state, 3, 3, false);
+	return sit2_execCmd(state, SIT2_CMD_CONFIG_PINS);
 }
 
 static u8 sit2_demod_setExtAGC(struct sit2_state *state, u8 agc1_mode, u8 agc1_inv, u8 agc1_kloop, u8 agc1_min,
 				u8 agc2_mode, u8 agc2_inv, u8 agc2_kloop, u8 agc2_min)
 {
-	state->sndBuffer[0] = 0x89;
 	state->sndBuffer[1] = (agc2_inv << 7) | (agc2_mode << 4) | (agc1_inv << 3) | agc1_mode;
 	state->sndBuffer[2] = agc1_kloop;
 	state->sndBuffer[3] = agc2_kloop;
 	state->sndBuffer[4] = agc1_min;
 	state->sndBuffer[5] = agc2_min;
-	return sit2_sendCommand(state, 6, 3, false);
+	return sit2_execCmd(state, SIT2_CMD_DD_EXT_AGC_TER);
 }
 
 static u8 sit2_demod_setDvbt2FEF(struct sit2_state *state, u8 fef_flag, u8 fef_inv)
 {
-	state->sndBuffer[0] = 0x51;
-	state->sndBuffer[1] = (fef_inv << 3) | fef_flag;
-	return sit2_sendCommand(state, 2, 12, false);
+	state->t2_fef_arg = (fef_inv << 3) | fef_flag;
+	state->sndBuffer[1] = state->t2_fef_arg;
+	return sit2_execCmd(state, SIT2_CMD_DVBT2_FEF);
 }
 
-static u8 sit2_demod_selectPlp(struct sit2_state *state, u8 plp_id, u8 plp_mode)
+/*
+ * the FEF command also reports the frame layout, query it with the
+ * arguments the demod already runs with so nothing is reconfigured
+ */
+static u8 sit2_demod_getDvbt2FEF(struct sit2_state *state, SIT2_T2_FEF *pFef)
 {
-	state->sndBuffer[0] = 0x52;
-	state->sndBuffer[1] = plp_id;
-	state->sndBuffer[1] = plp_mode;
-	return sit2_sendCommand(state, 3, 1, false);
+	u8 uret;
+	u8 *rsp = state->revBuffer;
+	state->sndBuffer[1] = state->t2_fef_arg;
+	uret = sit2_execCmd(state, SIT2_CMD_DVBT2_FEF_INFO);
+	if(uret != SIT2_ERROR_OK)
+		return uret;
+	
+	pFef->fef_type = rsp[1] & 0x0f;
+	pFef->fef_length = (rsp[7] << 24) | (rsp[6] << 16) | (rsp[5] << 8) | rsp[4];
+	pFef->fef_repetition = (rsp[11] << 24) | (rsp[10] << 16) | (rsp[9] << 8) | rsp[8];
+	return uret;
 }
 
-static u8 sit2_demod_init(struct sit2_state *state)
+static u8 sit2_demod_getPlpInfo(struct sit2_state *state, u8 plp_index, SIT2_T2_PLP_INFO *pInfo)
 {
-	u8 uret = SIT2_ERROR_OK;
-	u8 ts_mode, ts_clock;
-	u8 romid;
-	uret = sit2_demod_wakeUp(state, 1, 0);
+	u8 uret;
+	u8 *rsp = state->revBuffer;
+	state->sndBuffer[1] = plp_index;
+	uret = sit2_execCmd(state, SIT2_CMD_DVBT2_PLP_INFO);
 	if(uret != SIT2_ERROR_OK)
 		return uret;
+	
+	pInfo->plp_id = rsp[1];
+	pInfo->payload_type = rsp[2] & 0x1f;
+	pInfo->plp_type = (rsp[2] >> 5) & 0x07;
+	pInfo->group_id = rsp[3];
+	pInfo->cod = rsp[4] & 0x0f;
+	pInfo->mod = (rsp[4] >> 4) & 0x0f;
+	pInfo->rot = rsp[5] & 0x01;
+	pInfo->fec_type = (rsp[5] >> 1) & 0x03;
+	return uret;
+}
 
-	uret = sit2_demod_romId(state, &romid);
-	if(uret != SIT2_ERROR_OK)
+static u8 sit2_demod_getTxId(struct sit2_state *state, SIT2_T2_TX_ID *pTxId)
+{
+	u8 uret;
+	u8 *rsp = state->revBuffer;
+	uret = sit2_execCmd(state, SIT2_CMD_DVBT2_TX_ID);
+	if(uret != SIT2_ERROR_OK) {
+		memset(pTxId, 0, sizeof(*pTxId));
 		return uret;
+	}
+	
+	pTxId->available = rsp[1] & 0x01;
+	pTxId->cell_id = (rsp[3] << 8) | rsp[2];
+	pTxId->network_id = (rsp[5] << 8) | rsp[4];
+	pTxId->t2_system_id = (rsp[7] << 8) | rsp[6];
+	return uret;
+}
 
-	dprintk("%s: start to download ver[%d] patch!\n", __func__, romid);
-	if(romid == 2) { /* Ver20 */		
-		uret = sit2_demod_downloadFW(state, sit2_patch_2, SIT2_PATCH_2_SIZE, SIT2_PATCH_PER_LINE);
-		if(uret != SIT2_ERROR_OK)
-			return uret;
-		dprintk("%s: download ver[%d] patch sucessfully!\n", __func__, romid);
-	} else if (romid == 3) { /* Ver30 */
-		uret = sit2_demod_downloadFW(state, sit2_patch_3, SIT2_PATCH_3_SIZE, SIT2_PATCH_PER_LINE);
-		if(uret != SIT2_ERROR_OK)
-			return uret;
-		dprintk("%s: download ver[%d] patch sucessfully!\n", __func__, romid);		
+static u8 sit2_demod_selectPlp(struct sit2_state *state, u8 plp_id, u8 plp_mode)
+{
+	state->sndBuffer[1] = plp_id;
+	state->sndBuffer[2] = plp_mode;
+	return sit2_execCmd(state, SIT2_CMD_DVBT2_PLP_SELECT);
+}
+
+/* mant (7:4) * 10^exp (3:0) encoding used by the measurement window properties */
+static u16 sit2_window_code(u32 n)
+{
+	u8 exp = 0;
+	while (n > 15) {
+		n /= 10;
+		exp++;
 	}
+	return ((n ? n : 1) << 4) | exp;
+}
+
+static void sit2_set_windows(struct sit2_state *state)
+{
+	state->ber_window = clamp(sit2_ber_window, 1, 9);
+	sit2_sendProperty(state, 0x1004, (1 << 4) | state->ber_window, false);
+	sit2_sendProperty(state, 0x1005, sit2_window_code(max(sit2_ucb_window, 1)), false);
+}
+
+#define SIT2_TS_FREQ_DEFAULT	720	/* 10 kHz */
+#define SIT2_TS_FREQ_MIN	100
+#define SIT2_TS_FREQ_MAX	14550
+
+/* chip TS mode and clock from the board config, known before any setup ran */
+static void sit2_ts_config(struct sit2_state *state)
+{
+	if (state->config->ts_bus_mode == 1)
+		state->ts_mode = 3;
+	else if (state->config->ts_bus_mode == 2)
+		state->ts_mode = 6;
+	else
+		state->ts_mode = 0;
+	if (state->config->ts_clock_mode == 1)
+		state->ts_clock = 2;
+	else
+		state->ts_clock = 1;	
+}
+
+static void sit2_set_ts(struct sit2_state *state, u8 ts_clock, bool gapped, u16 freq)
+{
+	sit2_sendProperty(state, 0x100d, freq, false); /* ts clock frequency */
+	sit2_sendProperty(state, 0x1001, (0 << 8) | (0 << 7) | (gapped << 6) | (ts_clock << 4) | state->ts_mode, false);
+	state->ts_freq = freq;
+	state->ts_gapped = gapped;
+}
+
+/* back to the init time TS setup before acquiring a new mux */
+static void sit2_ts_restore(struct sit2_state *state)
+{
+	if (!state->ts_adapted)
+		return;
+	sit2_set_ts(state, state->ts_clock, false, SIT2_TS_FREQ_DEFAULT);
+	state->ts_adapted = false;
+}
+
+/* program the slowest manual TS clock that still carries the locked bitrate */
+static void sit2_ts_adapt_clock(struct sit2_state *state)
+{
+	SIT2_DD_STATUS dd_status;
+	u32 freq;
 	
-	uret = sit2_startFirmware(state, false);
-	if(uret != SIT2_ERROR_OK)
-		return uret;
-		
-	/* download default properties */
+	if (!sit2_ts_adapt || (state->ts_mode == 0))
+		return;
+	if ((sit2_demod_getStatus(state, 0, &dd_status) != SIT2_ERROR_OK) ||
+	    !dd_status.dl || !dd_status.ts_bit_rate)
+		return;
+	
+	freq = dd_status.ts_bit_rate * (100 + clamp(sit2_ts_margin, 0, 100));
+	/* parallel output moves a byte per clock */
+	freq = DIV_ROUND_UP(freq, (state->ts_mode == 6) ? 800 : 100);
+	freq = clamp_t(u32, freq, SIT2_TS_FREQ_MIN, SIT2_TS_FREQ_MAX);
+	
+	sit2_set_ts(state, 2, sit2_ts_adapt == 2, freq);
+	state->ts_bit_rate = dd_status.ts_bit_rate;
+	state->ts_adapted = true;
+	state->ts_adapts++;
+	dprintk("%s: bitrate %u0 kbps, ts clock %u0 kHz%s\n", __func__,
+		dd_status.ts_bit_rate, freq, state->ts_gapped ? " gapped" : "");
+}
+
+/* default demod properties, also replayed onto a chip adopted after a reload */
+static void sit2_demod_setup(struct sit2_state *state)
+{
 	sit2_demod_setMP(state, 1, 2, 1, 1);
 	sit2_demod_setExtAGC(state, 1, 0, 6, 0, 2, 0, 18, 0);
-	sit2_demod_setDvbt2FEF(state, 3, 0);
+	sit2_demod_setDvbt2FEF(state, SIT2_FEF_TUNER_FLAG, 0);
 	sit2_demod_setGPIO(state, 8, 0, 4, 0);
 	/* common */
 	sit2_sendProperty(state, 0x0401, 0, false);
@@ -671,20 +1781,9 @@ static u8 sit2_demod_init(struct sit2_state *state)
 	sit2_sendProperty(state, 0x100b, 5000, false);
 	sit2_sendProperty(state, 0x1007, 0x2400, false);
 	sit2_sendProperty(state, 0x100a, (0 << 9) | (0 << 8) | (2 << 4) | 8, false); /* set modulation */
-	sit2_sendProperty(state, 0x1004, (1 << 4) | 5, false);
-	sit2_sendProperty(state, 0x1005, (10 << 4) | 1, false);
-	sit2_sendProperty(state, 0x100d, 720, false); /* ts clock frequency */
-	if (state->config->ts_bus_mode == 1)
-		ts_mode = 3;
-	else if (state->config->ts_bus_mode == 2)
-		ts_mode = 6;
-	else
-		ts_mode = 0;
-	if (state->config->ts_clock_mode == 1)
-		ts_clock = 2;
-	else
-		ts_clock = 1;	
-	sit2_sendProperty(state, 0x1001, (0 << 8) | (0 << 7) | (0 << 6) | (ts_clock << 4) | ts_mode, false);	
+	sit2_set_windows(state);
+	sit2_set_ts(state, state->ts_clock, false, SIT2_TS_FREQ_DEFAULT);
+	state->ts_adapted = false;
 	sit2_sendProperty(state, 0x1009, (0 << 13) | (1 << 12) | (3 << 10) | (15 << 6) | (3 << 4) | 15, false);
 	sit2_sendProperty(state, 0x1008, (0 << 14) | (1 << 13) | (1 << 12) | (3 << 10) | (15 << 6) | (3 << 4) | 15, false);
 	/* DVBC */
@@ -708,7 +1807,42 @@ static u8 sit2_demod_init(struct sit2_state *state)
 	sit2_sendProperty(state, 0x0306, 0, false);
 	sit2_sendProperty(state, 0x0305, 0, false);
 	sit2_sendProperty(state, 0x0301, (3 << 2), false);
+}
+
+static u8 sit2_demod_init(struct sit2_state *state)
+{
+	u8 uret = SIT2_ERROR_OK;
+	u8 romid, *fw;
+	u32 fwSize = 0;
+	state->fw_valid = false;
+	uret = sit2_demod_wakeUp(state, 1, 0);
+	if(uret != SIT2_ERROR_OK)
+		return uret;
+
+	uret = sit2_demod_romId(state, &romid);
+	if(uret != SIT2_ERROR_OK)
+		return uret;
+
+	dprintk("%s: start to download ver[%d] patch!\n", __func__, romid);
+	if(sit2_demod_getPatch(romid, &fw, &fwSize)) {
+		uret = sit2_demod_downloadFW(state, fw, fwSize, SIT2_PATCH_PER_LINE);
+		if(uret != SIT2_ERROR_OK)
+			return uret;
+		dprintk("%s: download ver[%d] patch sucessfully!\n", __func__, romid);
+	}
+	
+	uret = sit2_startFirmware(state, false);
+	if(uret != SIT2_ERROR_OK)
+		return uret;
 	
+	/* remember what runs now, warm init compares against it */
+	if(sit2_demod_getRev(state, &state->fw_rev) == SIT2_ERROR_OK) {
+		state->fw_valid = true;
+		state->fw_romid = romid;
+		state->fw_crc = fwSize ? crc32_le(~0, fw, fwSize) : 0;
+	}
+	
+	sit2_demod_setup(state);
 	return uret;
 }
 
@@ -758,24 +1892,366 @@ static int sit2_setStandard(struct sit2_state *state, fe_delivery_system_t toSys
 	return 0;
 }
 
-int power_of_n (int n, int m)
+static void sit2_cold_init(struct sit2_state *state)
+{
+	sit2_demod_tuner_i2c_enable(state, 1);
+	sit2_tuner_init(state);
+	sit2_tuner_xout_enable(state, 1);
+	sit2_demod_init(state);
+	sit2_demod_tuner_i2c_enable(state, 0);
+	state->isInited = true;
+	state->current_system = SYS_UNDEFINED;
+}
+
+/*
+ * Called at the end of an operation. An operation that hits bus errors or
+ * timeouts restarts the demod. Errors that persist for sit2_recover_ms
+ * after that step on to tuner init, a warm re-init that replays all
+ * properties, and finally a full cold init.
+ * Returns true if the chip was re-initialised.
+ */
+static bool sit2_recover(struct sit2_state *state, u32 fails)
 {
-	int i, p = 1;
-	for (i=1; i<= m; i++) {
-		p = p*n;
+	ktime_t now = sit2_now(state);
+	
+	if (state->cmd_fails == fails) {
+		state->recover_level = SIT2_RECOVER_NONE;
+		return false;
 	}
+	if ((state->recover_level != SIT2_RECOVER_NONE) &&
+	    (ktime_ms_delta(now, state->recover_step) < max(sit2_recover_ms, 0)))
+		return false;
+	/* a cold init that did not help starts over */
+	if (state->recover_level >= SIT2_RECOVER_COLD_INIT)
+		state->recover_level = SIT2_RECOVER_NONE;
+	state->recover_level++;
+	state->recover_step = now;
+	
+	printk(KERN_INFO "%s: error %d, recovery level %d\n", __func__,
+	       state->last_error, state->recover_level);
+	switch (state->recover_level) {
+	case SIT2_RECOVER_DEMOD_RESTART:
+		state->rec_restarts++;
+		sit2_demod_reStart(state);
+		return false;
+	case SIT2_RECOVER_TUNER_INIT:
+		state->rec_tuner_inits++;
+		sit2_demod_tuner_i2c_enable(state, 1);
+		sit2_tuner_init(state);
+		sit2_tuner_xout_enable(state, 1);
+		sit2_demod_tuner_i2c_enable(state, 0);
+		break;
+	case SIT2_RECOVER_WARM_INIT:
+		state->rec_warm_inits++;
+		sit2_demod_tuner_i2c_enable(state, 1);
+		sit2_tuner_setup(state);
+		sit2_demod_setup(state);
+		sit2_demod_tuner_i2c_enable(state, 0);
+		break;
+	default:
+		state->rec_cold_inits++;
+		sit2_cold_init(state);
+		break;
+	}
+	/* the standard and FEF mode have to be programmed again */
+	state->current_system = SYS_UNDEFINED;
+	state->retune_pending = true;
+	state->params_valid = false;
+	return true;
+}
+
+static u8 sit2_rssi_band(u32 khz)
+{
+	u8 i;
+	for (i = 0; i < SIT2_RSSI_BANDS - 1; i++)
+		if (khz <= sit2_rssi_band_khz[i])
+			break;
+	return i;
+}
+
+/* tuner RSSI in 0.001 dBm, with the board offset for the band in use */
+static s32 sit2_rssi_mdbm(s8 rssi, u8 band)
+{
+	return rssi * 1000 + sit2_rssi_offset[band];
+}
+
+/* called with the lock held, at most once per sit2_stats_ms */
+static void sit2_stats_refresh(struct sit2_state *state, bool force)
+{
+	struct dtv_frontend_properties *c = &state->frontend.dtv_property_cache;
+	ktime_t now = sit2_now(state);
+	u8 uret;
+	
+	if (!force && state->rssi_valid &&
+	    (ktime_ms_delta(now, state->stats_time) < sit2_stats_ms))
+		return;
+	state->stats_time = now;
+	
+	sit2_demod_tuner_i2c_enable(state, 1);
+	uret = sit2_tuner_getStatus(state, 0, &state->tuner_status);
+	sit2_demod_tuner_i2c_enable(state, 0);
+	
+	c->strength.len = 1;
+	if (uret != SIT2_ERROR_OK) {
+		state->rssi_valid = false;
+		c->strength.stat[0].scale = FE_SCALE_NOT_AVAILABLE;
+		return;
+	}
+	state->rssi_band = sit2_rssi_band(c->frequency / 1000);
+	state->rssi_mdbm = sit2_rssi_mdbm(state->tuner_status.rssi, state->rssi_band);
+	state->rssi_valid = true;
+	c->strength.stat[0].scale = FE_SCALE_DECIBEL;
+	c->strength.stat[0].svalue = state->rssi_mdbm;
+}
+
+static u64 sit2_pow10(u8 n)
+{
+	u64 p = 1;
+	while (n--)
+		p *= 10;
 	return p;
 }
 
+/* bit errors in one BER window of 10^window bits, ber = mant/10 * 10^-exp */
+static u32 sit2_ber_errors(const SIT2_BER *ber, u8 window)
+{
+	return (u32)div64_u64(sit2_pow10(window) * ber->mant, 10 * sit2_pow10(ber->exp));
+}
+
+/* accumulate finished BER windows and uncorrectable packets, lock held */
+static void sit2_stats_accumulate(struct sit2_state *state)
+{
+	struct dtv_frontend_properties *c = &state->frontend.dtv_property_cache;
+	SIT2_DD_STATUS *dd_status = &state->dd_status;
+	u8 window = clamp(sit2_ber_window, 1, 9);
+	
+	c->post_bit_error.len = 1;
+	c->post_bit_count.len = 1;
+	c->block_error.len = 1;
+	if (!dd_status->dl) {
+		c->post_bit_error.stat[0].scale = FE_SCALE_NOT_AVAILABLE;
+		c->post_bit_count.stat[0].scale = FE_SCALE_NOT_AVAILABLE;
+		c->block_error.stat[0].scale = FE_SCALE_NOT_AVAILABLE;
+		return;
+	}
+	
+	/* the window was changed, the one running was counted with the old size */
+	if (window != state->ber_window) {
+		sit2_set_windows(state);
+		sit2_demod_getBer(state, 1, &state->ber);
+	/* berint flags a finished window, exp 0 means no result yet, rst acks berint only */
+	} else if (dd_status->berint &&
+		   sit2_demod_getBer(state, 1, &state->ber) == SIT2_ERROR_OK &&
+		   state->ber.exp != 0) {
+		state->ber_last = sit2_ber_errors(&state->ber, window);
+		state->ber_errors += state->ber_last;
+		state->ber_bits += sit2_pow10(window);
+		state->ber_windows++;
+	}
+	if (sit2_demod_getUncor(state, 1, &state->uncor) == SIT2_ERROR_OK)
+		state->ucb_total += state->uncor.errors;
+	
+	c->post_bit_error.stat[0].scale = FE_SCALE_COUNTER;
+	c->post_bit_error.stat[0].uvalue = state->ber_errors;
+	c->post_bit_count.stat[0].scale = FE_SCALE_COUNTER;
+	c->post_bit_count.stat[0].uvalue = state->ber_bits;
+	c->block_error.stat[0].scale = FE_SCALE_COUNTER;
+	c->block_error.stat[0].uvalue = state->ucb_total;
+}
+
+/*
+ * CNR needed for quasi error free reception in a Gaussian channel, by chip
+ * constellation and code rate coding. DVB-T and DVB-T2 after NorDig,
+ * DVB-C at BER 1e-4 before Reed-Solomon.
+ */
+struct sit2_cnr_req {
+	u8 constellation;
+	u8 code_rate;		/* 0 for DVB-C */
+	u16 cnr;		/* 0.1 dB */
+};
+
+static const struct sit2_cnr_req sit2_dvbt_cnr_tab[] = {
+	{ 3, 1, 51 }, { 3, 2, 69 }, { 3, 3, 79 }, { 3, 5, 89 }, { 3, 7, 97 },
+	{ 7, 1, 108 }, { 7, 2, 131 }, { 7, 3, 146 }, { 7, 5, 156 }, { 7, 7, 160 },
+	{ 9, 1, 165 }, { 9, 2, 187 }, { 9, 3, 202 }, { 9, 5, 216 }, { 9, 7, 225 },
+	{ 0 }
+};
+
+static const struct sit2_cnr_req sit2_dvbt2_cnr_tab[] = {
+	{ 3, 1, 35 }, { 3, 13, 47 }, { 3, 2, 56 }, { 3, 3, 66 }, { 3, 4, 72 }, { 3, 5, 77 },
+	{ 7, 1, 87 }, { 7, 13, 101 }, { 7, 2, 114 }, { 7, 3, 125 }, { 7, 4, 133 }, { 7, 5, 138 },
+	{ 9, 1, 130 }, { 9, 13, 148 }, { 9, 2, 162 }, { 9, 3, 177 }, { 9, 4, 187 }, { 9, 5, 194 },
+	{ 11, 1, 170 }, { 11, 13, 194 }, { 11, 2, 208 }, { 11, 3, 229 }, { 11, 4, 243 }, { 11, 5, 251 },
+	{ 0 }
+};
+
+static const struct sit2_cnr_req sit2_dvbc_cnr_tab[] = {
+	{ 7, 0, 200 }, { 8, 0, 230 }, { 9, 0, 260 }, { 10, 0, 290 }, { 11, 0, 320 },
+	{ 0 }
+};
+
+/* margin giving a score of 100 */
+#define SIT2_QUALITY_SPAN	100	/* 0.1 dB */
+
+static u16 sit2_cnr_required(const struct sit2_cnr_req *tab, u8 constellation, u8 code_rate)
+{
+	for (; tab->constellation; tab++)
+		if ((tab->constellation == constellation) && (tab->code_rate == code_rate))
+			return tab->cnr;
+	return 0;
+}
+
+/* CNR margin and score for the current modcod, lock held */
+static void sit2_stats_quality(struct sit2_state *state)
+{
+	struct dtv_frontend_properties *c = &state->frontend.dtv_property_cache;
+	u16 req = 0;
+	u8 cnr;
+	
+	c->cnr.len = 1;
+	state->quality_valid = false;
+	if (!state->dd_status.dl ||
+	    sit2_demod_getSystemStatus(state, 0, state->dd_status.modulation, &cnr) != SIT2_ERROR_OK) {
+		c->cnr.stat[0].scale = FE_SCALE_NOT_AVAILABLE;
+		return;
+	}
+	c->cnr.stat[0].scale = FE_SCALE_DECIBEL;
+	c->cnr.stat[0].svalue = cnr * 250;
+	
+	switch (state->dd_status.modulation) {
+	case 2: /*DVB-T*/
+		req = sit2_cnr_required(sit2_dvbt_cnr_tab, state->dvbt_status.constellation,
+					state->dvbt_status.rate_hp);
+		break;
+	case 7: /*DVB-T2*/
+		req = sit2_cnr_required(sit2_dvbt2_cnr_tab, state->dvbt2_status.constellation,
+					state->dvbt2_status.code_rate);
+		break;
+	case 3: /*DVB-C*/
+		req = sit2_cnr_required(sit2_dvbc_cnr_tab, state->dvbc_status.constellation, 0);
+		break;
+	}
+	if (!req)
+		return;
+	state->quality_cnr = cnr;
+	state->quality_req = req;
+	state->quality_margin = (cnr * 10) / 4 - req;
+	state->quality_score = clamp(state->quality_margin * 100 / SIT2_QUALITY_SPAN, 0, 100);
+	state->quality_valid = true;
+}
+
+static void sit2_wd_reset(struct sit2_state *state)
+{
+	state->wd_locked = false;
+	state->wd_stage = SIT2_WD_IDLE;
+}
+
+/*
+ * Follow dl in the status snapshot. A dropout first gets a grace period,
+ * then a demod restart with the current settings and only then a full
+ * retune by the frontend thread. Lock held.
+ */
+static void sit2_watchdog(struct sit2_state *state)
+{
+	ktime_t now = sit2_now(state);
+	u32 ms;
+	
+	if (state->dd_status.dl) {
+		if (state->wd_stage != SIT2_WD_IDLE) {
+			ms = ktime_ms_delta(now, state->wd_drop_time);
+			state->wd_recover_ms_last = ms;
+			state->wd_recover_ms_max = max(state->wd_recover_ms_max, ms);
+			if (state->wd_stage == SIT2_WD_RESTART)
+				state->wd_restart_relocks++;
+			else if (state->wd_stage == SIT2_WD_RETUNE)
+				state->wd_retune_relocks++;
+			dprintk("%s: relocked after %u ms\n", __func__, ms);
+			state->poll_fast = true;
+		}
+		state->wd_locked = true;
+		state->wd_stage = SIT2_WD_IDLE;
+		return;
+	}
+	if (!state->wd_locked || (sit2_wd_grace_ms <= 0))
+		return;
+	
+	switch (state->wd_stage) {
+	case SIT2_WD_IDLE:
+		state->poll_fast = true;
+		state->params_valid = false;
+		state->wd_dropouts++;
+		state->wd_drop_time = now;
+		state->wd_stage_time = now;
+		state->wd_stage = SIT2_WD_GRACE;
+		break;
+	case SIT2_WD_GRACE:
+		if (ktime_ms_delta(now, state->wd_stage_time) < sit2_wd_grace_ms)
+			break;
+		state->wd_restarts++;
+		sit2_demod_reStart(state);
+		state->wd_stage_time = now;
+		state->wd_stage = SIT2_WD_RESTART;
+		break;
+	case SIT2_WD_RESTART:
+		if (ktime_ms_delta(now, state->wd_stage_time) < sit2_wd_restart_ms)
+			break;
+		state->wd_retunes++;
+		state->retune_pending = true;
+		state->wd_stage_time = now;
+		state->wd_stage = SIT2_WD_RETUNE;
+		break;
+	case SIT2_WD_RETUNE:
+		/* left to the frontend thread, asked again while it does not relock */
+		if (ktime_ms_delta(now, state->wd_stage_time) < sit2_wd_restart_ms)
+			break;
+		state->wd_retunes++;
+		state->retune_pending = true;
+		state->wd_stage_time = now;
+		break;
+	}
+}
+
+static void sit2_stats_work(struct work_struct *work)
+{
+	struct sit2_state *state = container_of(work, struct sit2_state, stats_work.work);
+	int ms;
+	
+	sit2_lock(state, SIT2_OP_STATS);
+	if (!state->stats_running || state->current_system == SYS_UNDEFINED) {
+		sit2_unlock(state);
+		return;
+	}
+	/* the chip is on a scan channel, the watchdog must not chase it */
+	if (state->scanning) {
+		sit2_unlock(state);
+		schedule_delayed_work(&state->stats_work, msecs_to_jiffies(max(sit2_stats_ms, 100)));
+		return;
+	}
+	if (sit2_demod_getStatus(state, 0, &state->dd_status) == SIT2_ERROR_OK) {
+		sit2_watchdog(state);
+		sit2_stats_accumulate(state);
+		sit2_stats_quality(state);
+	}
+	sit2_stats_refresh(state, true);
+	/* poll fast while the watchdog is handling a dropout */
+	if ((state->wd_stage == SIT2_WD_GRACE) || (state->wd_stage == SIT2_WD_RESTART))
+		ms = SIT2_WD_POLL_MS;
+	else
+		ms = max(sit2_stats_ms, 100);
+	sit2_unlock(state);
+	schedule_delayed_work(&state->stats_work, msecs_to_jiffies(ms));
+}
+
 static int sit2_drv_read_signal_strength(struct dvb_frontend *fe, u16 *strength)
 {
 	struct sit2_state *state = fe->demodulator_priv;
-	sit2_demod_tuner_i2c_enable(state, 1);
-	sit2_tuner_getStatus(state, 0);
-	sit2_demod_tuner_i2c_enable(state, 0);
-	*strength = state->revBuffer[3] + 128;
-	/* scale value to 0x0000-0xffff from 0x0000-0x00ff */
-	*strength = *strength * 0xffff / 0x00ff;
+	s32 dbm;
+	sit2_lock(state, SIT2_OP_STRENGTH);
+	sit2_stats_refresh(state, false);
+	dbm = state->rssi_valid ? state->rssi_mdbm / 1000 : -128;
+	sit2_unlock(state);
+	/* scale -128..127 dBm to 0x0000-0xffff */
+	*strength = clamp(dbm + 128, 0, 0xff) * 0xffff / 0x00ff;
 	return 0;
 }
 
@@ -783,8 +2259,9 @@ static int sit2_drv_read_ucblocks(struct dvb_frontend *fe, u32 *ucblocks)
 {
 	struct sit2_state *state = fe->demodulator_priv;
 	
-	sit2_demod_getUncor(state, 0);
-	*ucblocks = (state->revBuffer[2] << 16) |  state->revBuffer[1];;
+	sit2_lock(state, SIT2_OP_UCB);
+	*ucblocks = (u32)state->ucb_total;
+	sit2_unlock(state);
 	
 	return 0;
 }
@@ -793,32 +2270,24 @@ static int sit2_drv_read_ber(struct dvb_frontend *fe, u32 *ber)
 {
 	struct sit2_state *state = fe->demodulator_priv;
 	
-	sit2_demod_getBer(state, 0);
-	if(state->revBuffer[1] != 0) { /* to do scale. */
-		*ber = state->revBuffer[2]/10/power_of_n(10, state->revBuffer[1]);
-	}
+	/* bit errors in the last finished window */
+	sit2_lock(state, SIT2_OP_BER);
+	*ber = state->ber_last;
+	sit2_unlock(state);
 	return 0;
 }
 
 static int sit2_drv_read_snr(struct dvb_frontend *fe, u16 *snr)
 {
 	struct sit2_state *state = fe->demodulator_priv;
-	SIT2_DD_STATUS dd_status;
+	u8 cnr;
 	
-	sit2_demod_getStatus(state, 0, &dd_status);
-	switch(dd_status.modulation) {
-	case 2: /*DVB-T*/
-		sit2_demod_getDVBTStatus(state, 0);
-		break;
-	case 7: /*DVB-T2*/
-		sit2_demod_getDVBT2Status(state, 0);
-		break;
-	case 3: /*DVB-C*/
-		sit2_demod_getDVBCStatus(state, 0);		
-		break;
-	}
+	sit2_lock(state, SIT2_OP_SNR);
+	sit2_demod_getStatus(state, 0, &state->dd_status);
+	sit2_demod_getSystemStatus(state, 0, state->dd_status.modulation, &cnr);
 	/* report SNR in dB * 10 */
-	*snr = state->revBuffer[3]/40;
+	*snr = cnr/40;
+	sit2_unlock(state);
 	return 0;
 }
 
@@ -826,8 +2295,25 @@ static int sit2_drv_read_status(struct dvb_frontend *fe, fe_status_t *status)
 {
 	struct sit2_state *state = fe->demodulator_priv;
 	SIT2_DD_STATUS dd_status;	
+	u32 fails;
 	*status = 0;
-	sit2_demod_getStatus(state, 0, &dd_status);
+	sit2_lock(state, SIT2_OP_STATUS);
+	fails = state->cmd_fails;
+	sit2_demod_getStatus(state, 0, &state->dd_status);
+	dd_status = state->dd_status;
+	sit2_recover(state, fails);
+	if (!dd_status.dl) {
+		state->poll_locked = false;
+		state->params_valid = false;
+	} else if (!state->poll_locked) {
+		state->poll_locked = true;
+		state->poll_lock_time = sit2_now(state);
+	}
+	/* hand a fresh dropout to the watchdog right away */
+	if (state->stats_running && state->wd_locked && !dd_status.dl &&
+	    (state->wd_stage == SIT2_WD_IDLE))
+		mod_delayed_work(system_wq, &state->stats_work, 0);
+	sit2_unlock(state);
 	if(dd_status.pcl)
 		*status = FE_HAS_SIGNAL | FE_HAS_CARRIER
 		    | FE_HAS_SYNC | FE_HAS_VITERBI;
@@ -842,198 +2328,423 @@ static int sit2_drv_get_frontend_algo(struct dvb_frontend *fe)
 	return DVBFE_ALGO_HW;
 }
 
-static fe_modulation_t sit2_convert_modulation(u8 constellation)
+/* chip codes to DVB API values, unknown codes map to AUTO */
+static const fe_modulation_t sit2_modulation_tab[64] = {
+	[0 ... 63]	= QAM_AUTO,
+	[3]		= QPSK,
+	[7]		= QAM_16,
+	[8]		= QAM_32,
+	[9]		= QAM_64,
+	[10]		= QAM_128,
+	[11]		= QAM_256,
+};
+
+static const fe_transmit_mode_t sit2_fftcode_tab[16] = {
+	[0 ... 15]	= TRANSMISSION_MODE_AUTO,
+	[10]		= TRANSMISSION_MODE_1K,
+	[11]		= TRANSMISSION_MODE_2K,
+	[12]		= TRANSMISSION_MODE_4K,
+	[13]		= TRANSMISSION_MODE_8K,
+	[14]		= TRANSMISSION_MODE_16K,
+	[15]		= TRANSMISSION_MODE_32K,
+};
+
+static const fe_guard_interval_t sit2_gicode_tab[8] = {
+	[0]		= GUARD_INTERVAL_AUTO,
+	[1]		= GUARD_INTERVAL_1_32,
+	[2]		= GUARD_INTERVAL_1_16,
+	[3]		= GUARD_INTERVAL_1_8,
+	[4]		= GUARD_INTERVAL_1_4,
+	[5]		= GUARD_INTERVAL_1_128,
+	[6]		= GUARD_INTERVAL_19_128,
+	[7]		= GUARD_INTERVAL_19_256,
+};
+
+static const fe_hierarchy_t sit2_hierarchycode_tab[8] = {
+	[0 ... 7]	= HIERARCHY_AUTO,
+	[1]		= HIERARCHY_NONE,
+	[2]		= HIERARCHY_1,
+	[3]		= HIERARCHY_2,
+	[5]		= HIERARCHY_4,
+};
+
+static const fe_code_rate_t sit2_coderate_tab[16] = {
+	[0 ... 15]	= FEC_AUTO,
+	[1]		= FEC_1_2,
+	[2]		= FEC_2_3,
+	[3]		= FEC_3_4,
+	[4]		= FEC_4_5,
+	[5]		= FEC_5_6,
+	[7]		= FEC_7_8,
+	[13]		= FEC_3_5,
+};
+
+#define sit2_convert_modulation(code)		sit2_modulation_tab[(code) & 0x3f]
+#define sit2_convert_fftcode(code)		sit2_fftcode_tab[(code) & 0x0f]
+#define sit2_convert_gicode(code)		sit2_gicode_tab[(code) & 0x07]
+#define sit2_convert_hierarchycode(code)	sit2_hierarchycode_tab[(code) & 0x07]
+#define sit2_convert_coderate(code)		sit2_coderate_tab[(code) & 0x0f]
+
+/* PLP list, transmitter ids and FEF layout of a locked T2 mux, read on demand, lock held */
+static void sit2_t2_read_l1(struct sit2_state *state)
+{
+	u8 i, num = min_t(u8, state->dvbt2_status.num_plp, SIT2_T2_PLP_MAX);
+	
+	for (i = 0; i < num; i++)
+		if (sit2_demod_getPlpInfo(state, i, &state->t2_plp[i]) != SIT2_ERROR_OK)
+			return;
+	state->t2_plp_num = num;
+	sit2_demod_getTxId(state, &state->t2_tx_id);
+	if (sit2_demod_getDvbt2FEF(state, &state->t2_fef) != SIT2_ERROR_OK)
+		memset(&state->t2_fef, 0, sizeof(state->t2_fef));
+	state->t2_l1_valid = true;
+	state->t2_l1_reads++;
+}
+
+/*
+ * Read and decode the parameters of the current signal, lock held.
+ * They are kept until the lock is lost or the frontend is retuned.
+ */
+static bool sit2_read_params(struct sit2_state *state)
 {
-	fe_modulation_t ret;
-	switch (constellation) {
-	case 7:
-		ret = QAM_16;
+	struct sit2_fe_params *p = &state->params;
+	SIT2_DVBT_STATUS *t = &state->dvbt_status;
+	SIT2_DVBT2_STATUS *t2 = &state->dvbt2_status;
+	SIT2_DVBC_STATUS *dc = &state->dvbc_status;
+	u8 cnr;
+	
+	state->params_valid = false;
+	state->t2_l1_valid = false;
+	if(sit2_demod_getStatus(state, 0, &state->dd_status) != SIT2_ERROR_OK)
+		return false;
+	if(sit2_demod_getSystemStatus(state, 0, state->dd_status.modulation, &cnr) != SIT2_ERROR_OK)
+		return false;
+	state->params_reads++;
+	
+	p->system = state->dd_status.modulation;
+	switch(p->system) {
+	case 2: /*DVB-T*/
+		p->modulation = sit2_convert_modulation(t->constellation);
+		p->transmission_mode = sit2_convert_fftcode(t->fft_mode);
+		p->guard_interval = sit2_convert_gicode(t->guard_int);
+		p->hierarchy = sit2_convert_hierarchycode(t->hierarchy);
+		p->code_rate_HP = sit2_convert_coderate(t->rate_hp);
+		p->code_rate_LP = sit2_convert_coderate(t->rate_lp);
+		p->inversion = t->sp_inv ? INVERSION_ON : INVERSION_OFF;
 		break;
-	case 8:
-		ret = QAM_32;
-		break;
-	case 9:
-		ret = QAM_64;
-		break;
-	case 10:
-		ret = QAM_128;
-		break;
-	case 11:
-		ret = QAM_256;
+	case 7: /*DVB-T2*/
+		p->modulation = sit2_convert_modulation(t2->constellation);
+		p->transmission_mode = sit2_convert_fftcode(t2->fft_mode);
+		p->guard_interval = sit2_convert_gicode(t2->guard_int);
+		p->fec_inner = sit2_convert_coderate(t2->code_rate);
+		p->inversion = t2->sp_inv ? INVERSION_ON : INVERSION_OFF;
 		break;
-	case 3:
-		ret = QPSK;
+	case 3: /*DVB-C*/
+		p->symbol_rate = state->dvbc_symrate;
+		p->modulation = sit2_convert_modulation(dc->constellation);
+		p->inversion = dc->sp_inv ? INVERSION_ON : INVERSION_OFF;
 		break;
-	default:
-		ret = QAM_AUTO;
-		break;		
 	}
-	return ret;				
+	state->params_valid = state->dd_status.dl;
+	if (state->params_valid)
+		state->params_freq = state->frontend.dtv_property_cache.frequency;
+	return true;
 }
 
-static fe_transmit_mode_t sit2_convert_fftcode(u8 fftcode)
+static int sit2_drv_get_frontend(struct dvb_frontend *fe)
 {
-	fe_transmit_mode_t ret;
-	switch (fftcode) {	
-	case 10:
-		ret = TRANSMISSION_MODE_1K;
-		break;
-	case 11:
-		ret = TRANSMISSION_MODE_2K;
-		break;
-	case 12:
-		ret = TRANSMISSION_MODE_4K;
-		break;
-	case 13:
-		ret = TRANSMISSION_MODE_8K;
+	struct sit2_state *state = fe->demodulator_priv;
+	struct dtv_frontend_properties *c = &fe->dtv_property_cache;
+	struct sit2_fe_params *p = &state->params;
+	int ret = 0;
+	sit2_lock(state, SIT2_OP_GET_FRONTEND);
+	if (state->params_valid)
+		state->params_hits++;
+	else if (!sit2_read_params(state)) {
+		sit2_unlock(state);
+		return ret;
+	}
+	switch(p->system) {
+	case 2: /*DVB-T*/
+		c->modulation = p->modulation;
+		c->transmission_mode = p->transmission_mode;
+		c->guard_interval = p->guard_interval;
+		c->hierarchy = p->hierarchy;
+		c->code_rate_HP = p->code_rate_HP;
+		c->code_rate_LP = p->code_rate_LP;
+		c->inversion = p->inversion;
 		break;
-	case 14:
-		ret = TRANSMISSION_MODE_16K;
+	case 7: /*DVB-T2*/
+		c->modulation = p->modulation;
+		c->transmission_mode = p->transmission_mode;
+		c->guard_interval = p->guard_interval;
+		c->fec_inner = p->fec_inner;
+		c->inversion = p->inversion;
+		c->stream_id = state->plp_id;
 		break;
-	case 15:
-		ret = TRANSMISSION_MODE_32K;
+	case 3: /*DVB-C*/
+		c->symbol_rate = p->symbol_rate;
+		c->modulation = p->modulation;
+		c->inversion = p->inversion;
 		break;
-	default:
-		ret = TRANSMISSION_MODE_AUTO;
-	}
+	}	
+	sit2_unlock(state);
 	return ret;
 }
 
-static fe_guard_interval_t sit2_convert_gicode(int gicode)
+static const u16 sit2_fft_size[SIT2_LOCK_MODES] = {
+	[TRANSMISSION_MODE_1K]	= 1024,
+	[TRANSMISSION_MODE_2K]	= 2048,
+	[TRANSMISSION_MODE_4K]	= 4096,
+	[TRANSMISSION_MODE_8K]	= 8192,
+	[TRANSMISSION_MODE_16K]	= 16384,
+	[TRANSMISSION_MODE_32K]	= 32768,
+};
+
+/* guard interval in 1/256 of the useful symbol */
+static const u8 sit2_gi_256[8] = {
+	[GUARD_INTERVAL_1_128]	= 2,
+	[GUARD_INTERVAL_1_32]	= 8,
+	[GUARD_INTERVAL_19_256]	= 19,
+	[GUARD_INTERVAL_1_16]	= 16,
+	[GUARD_INTERVAL_19_128]	= 38,
+	[GUARD_INTERVAL_1_8]	= 32,
+	[GUARD_INTERVAL_1_4]	= 64,
+};
+
+/*
+ * Acquisition window from the signal parameters. Requested AUTO values
+ * fall back to the last lock on the same frequency, then to the slowest
+ * mode. T requests can lock T2 too, so an unknown FFT means T2 32K.
+ * The static window is the worst case: learning only moves the first
+ * poll earlier, timeouts widen the window beyond it.
+ */
+static u8 sit2_lock_window(struct sit2_state *state,
+			   const struct dtv_frontend_properties *c,
+			   u32 *min_ms, u32 *max_ms)
 {
-	fe_guard_interval_t ret;
-	switch (gicode) {
-	case 1:
-		ret = GUARD_INTERVAL_1_32;
-		break;
-	case 2:
-		ret = GUARD_INTERVAL_1_16;
-		break;
-	case 3:
-		ret = GUARD_INTERVAL_1_8;
-		break;
-	case 4:
-		ret = GUARD_INTERVAL_1_4;
-		break;
-	case 5:
-		ret = GUARD_INTERVAL_1_128;
-		break;
-	case 6:
-		ret = GUARD_INTERVAL_19_128;
+	bool cached = state->params_freq == c->frequency;
+	u32 mode, gi, bw_khz, sr_ksym, sym_us, fft;
+	struct sit2_lock_stat *st;
+	bool auto_mode;
+	u8 bucket;
+	
+	switch (c->delivery_system) {
+	case SYS_DVBC_ANNEX_A:
+		mode = c->modulation;
+		if ((mode >= QAM_AUTO) && cached && (state->params.system == 3))
+			mode = state->params.modulation;
+		mode = min_t(u32, mode, SIT2_LOCK_MODES - 1);
+		sr_ksym = max_t(u32, c->symbol_rate / 1000, 1000);
+		*min_ms = 40 + 40 * 6900 / sr_ksym;
+		*max_ms = 400 + ((mode >= QAM_AUTO) ? 1600 : 600) * 6900 / sr_ksym;
+		bucket = 2 * SIT2_LOCK_MODES + mode;
 		break;
-	case 7:
-		ret = GUARD_INTERVAL_19_256;
-		break;		
 	default:
-		ret = GUARD_INTERVAL_AUTO;
+		mode = c->transmission_mode;
+		gi = c->guard_interval;
+		if ((mode >= SIT2_LOCK_MODES || !sit2_fft_size[mode]) && cached &&
+		    ((state->params.system == 2) || (state->params.system == 7))) {
+			mode = state->params.transmission_mode;
+			gi = state->params.guard_interval;
+		}
+		auto_mode = (mode >= SIT2_LOCK_MODES || !sit2_fft_size[mode]);
+		if (auto_mode)
+			mode = TRANSMISSION_MODE_32K;
+		fft = sit2_fft_size[mode];
+		gi = (gi < 8 && sit2_gi_256[gi]) ? sit2_gi_256[gi] : 64;
+		bw_khz = c->bandwidth_hz ? c->bandwidth_hz / 1000 : 8000;
+		/* elementary period is 7/(8*bw) us */
+		sym_us = div_u64((u64)fft * 7 * (256 + gi) * 1000, 8 * bw_khz * 256);
+		if ((c->delivery_system == SYS_DVBT) && (fft <= 8192)) {
+			*min_ms = 50 + 30 * sym_us / 1000;
+			*max_ms = 300 + 500 * sym_us / 1000;
+			bucket = mode;
+		} else {
+			*min_ms = 100 + 30 * sym_us / 1000;
+			*max_ms = 1000 + 1000 * sym_us / 1000;
+			bucket = SIT2_LOCK_MODES + mode;
+		}
+		/* whatever the demod finds, kept apart from known modes */
+		if (auto_mode)
+			bucket = ((c->delivery_system == SYS_DVBT) ? 0 : SIT2_LOCK_MODES) +
+				 TRANSMISSION_MODE_AUTO;
+		break;
 	}
-	return ret;
+	
+	*min_ms = clamp_t(u32, *min_ms, 20, 1000);
+	*max_ms = clamp_t(u32, *max_ms, *min_ms + 100, 10000);
+	st = &state->lock_stat[bucket];
+	if (sit2_lock_learn) {
+		if (st->samples >= SIT2_LOCK_LEARN_MIN)
+			*min_ms = clamp_t(u32, st->best_ms * 3 / 4, 20, *min_ms);
+		*max_ms = min_t(u32, *max_ms + st->extend_ms, 10000);
+	}
+	state->lock_min_ms = *min_ms;
+	state->lock_max_ms = *max_ms;
+	return bucket;
 }
 
-static fe_hierarchy_t sit2_convert_hierarchycode(int hierarchycode)
+/* model slot of the parameters the demod locked with, params read */
+static int sit2_lock_bucket_detected(struct sit2_state *state)
 {
-	fe_hierarchy_t ret;
-	switch (hierarchycode) {
-	case 1:
-		ret = HIERARCHY_NONE;
-		break;
-	case 2:
-		ret = HIERARCHY_1;
-		break;
-	case 3:
-		ret = HIERARCHY_2;
-		break;
-	case 5:
-		ret = HIERARCHY_4;
-		break;
-	default:
-		ret = HIERARCHY_AUTO;
+	u32 mode;
+	
+	switch (state->params.system) {
+	case 2: /*DVB-T*/
+	case 7: /*DVB-T2*/
+		mode = state->params.transmission_mode;
+		if ((mode >= SIT2_LOCK_MODES) || !sit2_fft_size[mode])
+			return -1;
+		return ((state->params.system == 2) && (sit2_fft_size[mode] <= 8192)) ?
+		       mode : SIT2_LOCK_MODES + mode;
+	case 3: /*DVB-C*/
+		return 2 * SIT2_LOCK_MODES +
+		       min_t(u32, state->params.modulation, SIT2_LOCK_MODES - 1);
 	}
-	return ret;
+	return -1;
 }
 
-static fe_code_rate_t sit2_convert_coderate(int coderate)
+static void sit2_lock_learn_time(struct sit2_state *state, u8 bucket, u32 ms)
 {
-	fe_code_rate_t ret;
-	switch (coderate) {
-	case 1:
-		ret = FEC_1_2;
-		break;
-	case 2:
-		ret = FEC_2_3;
-		break;
-	case 3:
-		ret = FEC_3_4;
-		break;
-	case 4:
-		ret = FEC_4_5;
-		break;
-	case 5:
-		ret = FEC_5_6;
-		break;
-	case 7:
-		ret = FEC_7_8;
-		break;
-	case 13:
-		ret = FEC_3_5;
-		break;		
-	default:
-		ret = FEC_AUTO;
+	struct sit2_lock_stat *st = &state->lock_stat[bucket];
+	
+	ms = min_t(u32, ms, U16_MAX);
+	if (!st->samples) {
+		st->avg_ms = st->best_ms = st->worst_ms = ms;
+	} else {
+		st->avg_ms = (st->avg_ms * 7 + ms) / 8;
+		st->best_ms = min_t(u32, st->best_ms, ms);
+		st->worst_ms = max_t(u32, st->worst_ms, ms);
 	}
-	return ret;
+	if (st->samples < U16_MAX)
+		st->samples++;
 }
 
-static int sit2_drv_get_frontend(struct dvb_frontend *fe)
+/* file a lock under what was detected and, for AUTO requests, the AUTO slot */
+static void sit2_lock_learn_lock(struct sit2_state *state, u8 req_bucket, u32 ms)
 {
-	struct sit2_state *state = fe->demodulator_priv;
-	struct dtv_frontend_properties *c = &fe->dtv_property_cache;
-	int ret = 0;
-	SIT2_DD_STATUS dd_status;
-	sit2_demod_getStatus(state, 0, &dd_status);
-	switch(dd_status.modulation) {
-	case 2: /*DVB-T*/
-		sit2_demod_getDVBTStatus(state, 0);
-		c->modulation = sit2_convert_modulation(state->revBuffer[8] & 0x3f);
-		c->transmission_mode = sit2_convert_fftcode(state->revBuffer[10] & 0x0f);
-		c->guard_interval = sit2_convert_gicode((state->revBuffer[10] >> 4) & 0x07);
-		c->hierarchy = sit2_convert_hierarchycode(state->revBuffer[11] & 0x07);
-		c->code_rate_HP = sit2_convert_coderate(state->revBuffer[9] & 0x0f);
-		c->code_rate_LP = sit2_convert_coderate((state->revBuffer[9] >> 4) & 0x0f);
-		c->inversion = ((state->revBuffer[8] >> 6) & 0x01) ? INVERSION_ON : INVERSION_OFF;
-		break;
-	case 7: /*DVB-T2*/
-		sit2_demod_getDVBT2Status(state, 0);
-		c->modulation = sit2_convert_modulation(state->revBuffer[8] & 0x3f);
-		c->transmission_mode = sit2_convert_fftcode(state->revBuffer[9] & 0x0f);
-		c->guard_interval = sit2_convert_gicode((state->revBuffer[9] >> 4) & 0x07);
-		c->fec_inner = sit2_convert_coderate(state->revBuffer[12] & 0x0f);
-		c->inversion = ((state->revBuffer[8] >> 6) & 0x01) ? INVERSION_ON : INVERSION_OFF;
-		break;
-	case 3: /*DVB-C*/
-		sit2_demod_getDVBCStatus(state, 0);
-		c->symbol_rate = state->dvbc_symrate;
-		c->modulation = sit2_convert_modulation(state->revBuffer[8] & 0x3f);
-		c->inversion = ((state->revBuffer[8] >> 6) & 0x01) ? INVERSION_ON : INVERSION_OFF;
-		break;
-	}	
-	return ret;
+	struct sit2_lock_stat *st = &state->lock_stat[req_bucket];
+	int bucket = sit2_lock_bucket_detected(state);
+	
+	state->lock_last_ms = ms;
+	/* a lock inside the static window takes back half of any widening */
+	if (ms + st->extend_ms <= state->lock_max_ms)
+		st->extend_ms /= 2;
+	if (bucket >= 0)
+		sit2_lock_learn_time(state, bucket, ms);
+	if ((bucket != req_bucket) &&
+	    ((req_bucket % SIT2_LOCK_MODES == TRANSMISSION_MODE_AUTO) ||
+	     (req_bucket == 2 * SIT2_LOCK_MODES + QAM_AUTO)))
+		sit2_lock_learn_time(state, req_bucket, ms);
 }
 
-static int sit2_drv_set_frontend(struct dvb_frontend *fe)
+/* no lock within the window: widen it by half the static size, at most double */
+static void sit2_lock_learn_timeout(struct sit2_state *state, u8 bucket)
+{
+	struct sit2_lock_stat *st = &state->lock_stat[bucket];
+	u32 base = state->lock_max_ms - st->extend_ms;
+	
+	state->lock_timeouts++;
+	/* a wrong guess of the DVB-C search says nothing about the channel */
+	if (state->dvbc_probing)
+		return;
+	if (st->timeouts < U16_MAX)
+		st->timeouts++;
+	st->extend_ms = min_t(u32, st->extend_ms + base / 2, base);
+}
+
+static bool sit2_set_frontend_locked(struct sit2_state *state,
+				     const struct dtv_frontend_properties *c);
+
+/*
+ * DVB-C without a symbol rate: try the candidates in order of their last
+ * lock on this device and move the one that locks to the front. The demod
+ * needs the rate, so a constellation no candidate has is tried at the
+ * common rates and joins the candidates once it locks.
+ */
+static bool sit2_dvbc_auto(struct sit2_state *state,
+			   const struct dtv_frontend_properties *c)
+{
+	struct dtv_frontend_properties t = *c;
+	struct sit2_dvbc_cand hit;
+	u32 skips = state->rssi_floor_skips;
+	int i, matched = 0;
+	u32 r;
+	
+	state->dvbc_auto_runs++;
+	for (i = 0; i < SIT2_DVBC_CANDS; i++) {
+		/* a given constellation only leaves the symbol rate to search */
+		if ((c->modulation != QAM_AUTO) &&
+		    (state->dvbc_cand[i].modulation != c->modulation))
+			continue;
+		matched++;
+		t.symbol_rate = state->dvbc_cand[i].symbol_rate;
+		if (c->modulation == QAM_AUTO)
+			t.modulation = state->dvbc_cand[i].modulation;
+		state->dvbc_auto_tries++;
+		if (sit2_set_frontend_locked(state, &t))
+			break;
+		/* below the RSSI floor no candidate can do better */
+		if (state->rssi_floor_skips != skips)
+			return false;
+	}
+	if (i < SIT2_DVBC_CANDS) {
+		hit = state->dvbc_cand[i];
+	} else {
+		/* the candidates with this constellation had their go */
+		if (matched)
+			return false;
+		/* none uses it (QAM16/32/128), try the common rates with it */
+		for (r = 0; r < ARRAY_SIZE(sit2_dvbc_rates); r++) {
+			t.symbol_rate = sit2_dvbc_rates[r];
+			state->dvbc_auto_tries++;
+			if (sit2_set_frontend_locked(state, &t))
+				break;
+			if (state->rssi_floor_skips != skips)
+				return false;
+		}
+		if (r == ARRAY_SIZE(sit2_dvbc_rates))
+			return false;
+		/* becomes a candidate in place of the least recent one */
+		hit.symbol_rate = t.symbol_rate;
+		hit.modulation = t.modulation;
+		i = SIT2_DVBC_CANDS - 1;
+	}
+	
+	dprintk("%s: locked at %u sym/s, candidate %d\n", __func__, t.symbol_rate, i);
+	state->dvbc_auto_locks++;
+	memmove(&state->dvbc_cand[1], &state->dvbc_cand[0], i * sizeof(hit));
+	state->dvbc_cand[0] = hit;
+	return true;
+}
+
+static bool sit2_set_frontend_locked(struct sit2_state *state,
+				     const struct dtv_frontend_properties *c)
 {
-	struct dtv_frontend_properties *c = &fe->dtv_property_cache;
-	struct sit2_state *state = fe->demodulator_priv;
 	int req_plp_id = 0;
-	u8 uret, req_qam, req_bandwidth = 0;
+	u8 req_qam, req_bandwidth = 0;
 	u32 max_lock_time = 5000, min_lock_time = 100;
 	u32 ulCount, ulTick, ulDelay;
 	SIT2_DD_STATUS dd_status;
-	bool bLock = false, bSearch = true;
+	bool bLock = false, bSearch = true, bCarrier = false;
+	ktime_t start;
+	u8 bucket;
+	u32 ms;
 	
+	state->params_valid = false;
+	if ((c->delivery_system == SYS_DVBC_ANNEX_A) && !c->symbol_rate &&
+	    !state->dvbc_probing) {
+		state->dvbc_probing = true;
+		bLock = sit2_dvbc_auto(state, c);
+		state->dvbc_probing = false;
+		return bLock;
+	}
 	dprintk(
 	     "%s: system=%d frequency=%d bandwidth=%d symrate=%d qam=%d stream_id=%d\n",
 	     __func__, c->delivery_system, c->frequency, c->bandwidth_hz, c->symbol_rate, c->modulation, c->stream_id);
 	     	
+	sit2_ts_restore(state);
 	sit2_setStandard(state, c->delivery_system);
 	switch (c->modulation) {
 	case QAM_16:
@@ -1064,8 +2775,7 @@ static int sit2_drv_set_frontend(struct dvb_frontend *fe)
 	switch(c->delivery_system) {
 	case SYS_DVBT:
 	case SYS_DVBT2:
-		max_lock_time = 5000;
-		min_lock_time = 100;
+		bucket = sit2_lock_window(state, c, &min_lock_time, &max_lock_time);
 		sit2_sendProperty(state, 0x1201, state->stream, false);
 		if(req_plp_id != -1)
 			sit2_demod_selectPlp(state, req_plp_id, 1);
@@ -1078,8 +2788,7 @@ static int sit2_drv_set_frontend(struct dvb_frontend *fe)
 		sit2_sendProperty(state, 0x100a, (1 << 9) | (0 << 8) | (15 << 4) | req_bandwidth, false);
 		break;
 	case SYS_DVBC_ANNEX_A:
-		max_lock_time = 2000;
-		min_lock_time = 80;
+		bucket = sit2_lock_window(state, c, &min_lock_time, &max_lock_time);
 		req_bandwidth = 8;
 		state->dvbc_symrate = c->symbol_rate;
 		sit2_sendProperty(state, 0x100a, (3 << 4) | req_bandwidth, false);
@@ -1088,26 +2797,43 @@ static int sit2_drv_set_frontend(struct dvb_frontend *fe)
 		break;
 	default:
 		dprintk("%s, error! unsupport delivery system - %d!", __func__, c->delivery_system);
+		bucket = 0;
 		break;
 	}
+	dprintk("%s: lock window %u..%u ms\n", __func__, min_lock_time, max_lock_time);
 	
 	/* tune tuner frequency */
 	sit2_demod_tuner_i2c_enable(state, 1);
 	sit2_tuner_setFreq(state, c->frequency, c->delivery_system, req_bandwidth);
+	if (sit2_rssi_floor) {
+		/* nothing at the tuner input, do not bother the demod */
+		state->rssi_floor_checks++;
+		if ((sit2_tuner_getStatus(state, 0, &state->tuner_status) == SIT2_ERROR_OK) &&
+		    (sit2_rssi_mdbm(state->tuner_status.rssi, sit2_rssi_band(c->frequency / 1000))
+		     < sit2_rssi_floor * 1000)) {
+			sit2_demod_tuner_i2c_enable(state, 0);
+			dprintk("%s: rssi %d dBm below floor, skipped\n", __func__,
+				state->tuner_status.rssi);
+			state->rssi_floor_skips++;
+			return false;
+		}
+	}
 	sit2_demod_tuner_i2c_enable(state, 0);
 	
 	sit2_demod_reStart(state);
+	start = sit2_now(state);
 	
 	/* check status */
   	ulCount = 0;
   	ulDelay = 10;
   	ulTick = max_lock_time/ulDelay;
-  	msleep(min_lock_time);
+  	sit2_msleep(state, min_lock_time);
   	
   	while(bSearch) {
   		ulCount++;
   		
-  		uret = sit2_demod_getStatus(state, 1, &dd_status);
+  		/* a failed read comes back zeroed, i.e. not locked yet */
+  		sit2_demod_getStatus(state, 1, &dd_status);
   		switch(c->delivery_system) {
   		case SYS_DVBT:
   		case SYS_DVBT2:
@@ -1117,7 +2843,7 @@ static int sit2_drv_set_frontend(struct dvb_frontend *fe)
 						sit2_demod_selectPlp(state, req_plp_id, 1);
 					else
 						sit2_demod_selectPlp(state, 0, 0);
-  					msleep(340);
+  					sit2_msleep(state, 340);
   				}
   				bLock = true;
   				bSearch = false;
@@ -1128,6 +2854,17 @@ static int sit2_drv_set_frontend(struct dvb_frontend *fe)
   			if(dd_status.dl) {
   				bLock = true;
   				bSearch = false;
+  				break;
+  			}
+  			/* empty channel: no-signal flag, or no carrier within the window */
+  			bCarrier |= dd_status.pcl;
+  			if(dd_status.rsqint_bit5 ||
+  			   (!bCarrier && (sit2_dvbc_nosignal_ms > 0) &&
+  			    (min_lock_time + ulCount * ulDelay >= sit2_dvbc_nosignal_ms))) {
+  				dprintk("%s: no DVB-C signal after %u ms\n", __func__,
+  					min_lock_time + ulCount * ulDelay);
+  				state->dvbc_nosignal_aborts++;
+  				bSearch = false;
   			}
   			break;
   		default:
@@ -1137,80 +2874,1075 @@ static int sit2_drv_set_frontend(struct dvb_frontend *fe)
   		}
   		
   		if(bSearch)
-  			msleep(10);
-  		if (ulCount >= ulTick)
+  			sit2_msleep(state, 10);
+  		if (bSearch && (ulCount >= ulTick)) {
+  			sit2_lock_learn_timeout(state, bucket);
   			bSearch = false;
+  		}
   	}	
+	if (bLock) {
+		ms = ktime_ms_delta(sit2_now(state), start);
+		/* the model is keyed by what locked, not by what was asked for */
+		if (sit2_read_params(state))
+			state->params_freq = c->frequency;
+		sit2_lock_learn_lock(state, bucket, ms);
+	}
+	return bLock;
+}
+
+/*
+ * Run a list of acquisitions, taking the lock for one entry at a time so
+ * the frontend is not shut out for the whole list. A tune, a sleep or a
+ * cancel in between ends the scan. Returns the number of entries done.
+ */
+static int sit2_scan(struct sit2_state *state, struct sit2_scan_result *res, u32 num)
+{
+	struct dtv_frontend_properties c;
+	int plp_id;
+	ktime_t start;
+	u8 cnr;
+	u32 i;
+	int gen;
+	
+	sit2_lock(state, SIT2_OP_SCAN);
+	if (!state->powered || state->scanning) {
+		sit2_unlock(state);
+		return -EAGAIN;
+	}
+	gen = atomic_read(&state->tune_gen);
+	plp_id = state->plp_id;
+	state->scanning = true;
+	sit2_wd_reset(state);
+	sit2_unlock(state);
+	for (i = 0; i < num; i++) {
+		memset(&c, 0, sizeof(c));
+		c.delivery_system = res[i].system;
+		c.frequency = res[i].frequency;
+		c.modulation = QAM_AUTO;
+		c.transmission_mode = TRANSMISSION_MODE_AUTO;
+		c.guard_interval = GUARD_INTERVAL_AUTO;
+		if (res[i].system == SYS_DVBC_ANNEX_A)
+			c.symbol_rate = res[i].rate;
+		else
+			c.bandwidth_hz = res[i].rate;
+		c.stream_id = (res[i].stream < 0) ? NO_STREAM_ID_FILTER : res[i].stream;
+		
+		sit2_lock(state, SIT2_OP_SCAN);
+		if ((atomic_read(&state->tune_gen) != gen) || !state->powered) {
+			sit2_unlock(state);
+			break;
+		}
+		start = sit2_now(state);
+		res[i].lock = sit2_set_frontend_locked(state, &c);
+		res[i].lock_ms = min_t(s64, ktime_ms_delta(sit2_now(state), start), U16_MAX);
+		if (res[i].lock) {
+			sit2_demod_getStatus(state, 0, &state->dd_status);
+			res[i].detected = state->dd_status.modulation;
+			if (sit2_demod_getSystemStatus(state, 0, res[i].detected, &cnr) == SIT2_ERROR_OK)
+				res[i].cnr = cnr;
+			if (res[i].detected == 7)
+				res[i].num_plp = state->dvbt2_status.num_plp;
+		}
+		sit2_unlock(state);
+	}
+	sit2_lock(state, SIT2_OP_SCAN);
+	state->scanning = false;
+	state->scans++;
+	if (i < num)
+		state->scan_stops++;
+	/* a tune in between already put the frontend where it wants to be */
+	if (atomic_read(&state->tune_gen) == gen) {
+		state->plp_id = plp_id;
+		/* put a running frontend back on its own channel */
+		state->retune_pending = state->stats_running;
+	}
+	sit2_unlock(state);
+	return i;
+}
+
+static void sit2_power_up(struct sit2_state *state);
+
+static int sit2_drv_set_frontend(struct dvb_frontend *fe)
+{
+	struct sit2_state *state = fe->demodulator_priv;
+	bool bLock;
+	u32 fails;
+	int attempt = 0;
+	
+	/* before the lock, so a scan stops at its next entry instead of racing us for it */
+	atomic_inc(&state->tune_gen);
+	sit2_lock(state, sit2_tune_op(fe->dtv_property_cache.delivery_system));
+	/* powered down across system sleep, the frontend thread brings it back */
+	if (!state->powered)
+		sit2_power_up(state);
+	if (state->pm_retune) {
+		state->pm_retune = false;
+		state->pm_retunes++;
+	}
+	/* a watchdog retune keeps its dropout open so the relock gets timed */
+	if (state->wd_stage != SIT2_WD_RETUNE)
+		sit2_wd_reset(state);
+	state->poll_locked = false;
+	state->retune_pending = false;
+	for (;;) {
+		fails = state->cmd_fails;
+		bLock = sit2_set_frontend_locked(state, &fe->dtv_property_cache);
+		if (!sit2_recover(state, fails) || (attempt++ > 0))
+			break;
+		/* chip was re-initialised, tune once more */
+		state->retune_pending = false;
+	}
+	if (bLock)
+		sit2_ts_adapt_clock(state);
+	state->stats_running = true;
+	sit2_unlock(state);
+	schedule_delayed_work(&state->stats_work, msecs_to_jiffies(sit2_stats_ms));
 
 	if (bLock && state->config->start_ctrl)
 		state->config->start_ctrl(fe);
 	return 0;
 }
 
+/* poll fast while acquiring or recovering, back off once the lock has settled */
+static unsigned int sit2_poll_delay(struct sit2_state *state)
+{
+	int ms;
+	
+	mutex_lock(&state->lock);
+	if (!state->poll_locked || state->poll_fast || state->retune_pending ||
+	    (state->wd_stage != SIT2_WD_IDLE))
+		ms = sit2_poll_fast_ms;
+	else if (ktime_ms_delta(sit2_now(state), state->poll_lock_time) < sit2_poll_stable_ms)
+		ms = SIT2_POLL_DEFAULT_MS;
+	else
+		ms = sit2_poll_slow_ms;
+	state->poll_fast = false;
+	state->poll_ms = clamp(ms, 10, 10000);
+	mutex_unlock(&state->lock);
+	return msecs_to_jiffies(state->poll_ms);
+}
+
 static int sit2_drv_tune(struct dvb_frontend *fe,
 			bool re_tune,
 			unsigned int mode_flags,
 			unsigned int *delay,
 			fe_status_t *status)
 {	
-	*delay = HZ / 5;	
-	if (re_tune) {
-		int ret = sit2_drv_set_frontend(fe);
+	struct sit2_state *state = fe->demodulator_priv;
+	int ret;
+	if (re_tune || state->retune_pending) {
+		ret = sit2_drv_set_frontend(fe);
 		if (ret)
 			return ret;
 	}	
-	return sit2_drv_read_status(fe, status);
+	ret = sit2_drv_read_status(fe, status);
+	*delay = sit2_poll_delay(state);
+	return ret;
 }
 
-static int sit2_drv_init(struct dvb_frontend *fe)
+static void sit2_power_down(struct sit2_state *state)
 {
-	struct sit2_state *state = fe->demodulator_priv;
-
-	dprintk("%s: init=%d\n", __func__, state->isInited);
+	sit2_demod_powerDown(state);
 	
 	sit2_demod_tuner_i2c_enable(state, 1);
+	sit2_tuner_xout_enable(state, 0);
+	sit2_tuner_standby(state);
+	sit2_demod_tuner_i2c_enable(state, 0);
 	
-	if(state->isInited) {
-		sit2_tuner_wakeUp(state);		
-	} else {
-		sit2_tuner_init(state);
+	state->pm_system = state->current_system;
+	state->restore_pending = state->system_sleeping;
+	state->suspend_pending = false;
+	state->current_system = SYS_UNDEFINED;
+	state->powered = false;
+	state->params_valid = false;
+}
+
+static void sit2_suspend_work(struct work_struct *work)
+{
+	struct sit2_state *state = container_of(work, struct sit2_state, suspend_work.work);
+
+	sit2_lock(state, SIT2_OP_SLEEP);
+	if (state->suspend_pending) {
+		dprintk("%s: idle, powering down\n", __func__);
+		sit2_power_down(state);
+		state->pm_suspends++;
 	}
+	sit2_unlock(state);
+}
+
+/* resume tuner and demod without downloading anything, false if the chip lost its state */
+static bool sit2_warm_start(struct sit2_state *state)
+{
+	bool adopt = !state->fw_valid;
+	u32 fails;
+	
+	if(sit2_tuner_wakeUp(state) != SIT2_ERROR_OK)
+		return false;
 	sit2_tuner_xout_enable(state, 1);
+	if(sit2_demod_wakeUp(state, 8, 1) != SIT2_ERROR_OK)
+		return false;
+	if(!sit2_fw_verify)
+		return true;
+	if(sit2_demod_checkFW(state) != SIT2_ERROR_OK) {
+		printk(KERN_INFO "%s: demod firmware lost, reloading\n", __func__);
+		return false;
+	}
+	if(adopt) {
+		/* left running by an earlier load, nothing of its setup is known */
+		fails = state->cmd_fails;
+		sit2_tuner_setup(state);
+		sit2_demod_setup(state);
+		state->current_system = SYS_UNDEFINED;
+		if(state->cmd_fails != fails) {
+			state->fw_valid = false;
+			return false;
+		}
+		state->fw_adopts++;
+	}
+	state->fw_verified++;
+	return true;
+}
+
+/* bring a powered down chip back up, lock held */
+static void sit2_power_up(struct sit2_state *state)
+{
+	bool warm;
+	u32 fails;
+
+	state->powered = true;
 	
-	if(state->isInited) {		
-		sit2_demod_wakeUp(state, 8, 1);
-	} else {
-		sit2_demod_init(state);
+	sit2_demod_tuner_i2c_enable(state, 1);
+	warm = (state->isInited || sit2_fw_verify) && sit2_warm_start(state);
+	sit2_demod_tuner_i2c_enable(state, 0);
+	
+	if(warm) {
+		if(state->isInited)
+			state->pm_cold_resumes++;
 		state->isInited = true;
+	} else {
+		if(state->isInited)
+			state->fw_reloads++;
+		fails = state->cmd_fails;
+		sit2_cold_init(state);
+		if(state->cmd_fails != fails) {
+			/* one more go before giving up on the chip */
+			state->rec_cold_inits++;
+			sit2_cold_init(state);
+		}
 	}	
 	
-	sit2_demod_tuner_i2c_enable(state, 0);
+	if (state->restore_pending) {
+		/* back from system sleep, put the demod back in the last standard */
+		state->restore_pending = false;
+		if (state->pm_system != SYS_UNDEFINED)
+			sit2_setStandard(state, state->pm_system);
+	}
+}
+
+static int sit2_drv_init(struct dvb_frontend *fe)
+{
+	struct sit2_state *state = fe->demodulator_priv;
+
+	dprintk("%s: init=%d pending=%d\n", __func__, state->isInited, state->suspend_pending);
+	
+	sit2_lock(state, SIT2_OP_INIT);
+	if (state->suspend_pending) {
+		/* autosuspend did not expire, chip is still up and tuned */
+		state->suspend_pending = false;
+		cancel_delayed_work(&state->suspend_work);
+		state->pm_warm_resumes++;
+		sit2_unlock(state);
+		return 0;
+	}
+	sit2_power_up(state);
+	sit2_unlock(state);
 	return 0;
 }
 
+/*
+ * Power down whatever is up before system sleep. Resume only marks a
+ * running tune for a retune: the chip is brought back by the frontend
+ * thread, so the firmware load and the lock wait do not hold up the
+ * resume of other drivers.
+ */
+static int sit2_pm_notify(struct notifier_block *nb, unsigned long action, void *data)
+{
+	struct sit2_state *state = container_of(nb, struct sit2_state, pm_nb);
+	bool retune;
+
+	switch (action) {
+	case PM_SUSPEND_PREPARE:
+	case PM_HIBERNATION_PREPARE:
+		sit2_lock(state, SIT2_OP_SLEEP);
+		state->system_sleeping = true;
+		if (state->powered) {
+			if (state->stats_running) {
+				/* in use, tune it again on resume */
+				state->pm_retune = true;
+				state->stats_running = false;
+				sit2_wd_reset(state);
+			}
+			sit2_power_down(state);
+			state->pm_suspends++;
+		}
+		sit2_unlock(state);
+		cancel_delayed_work_sync(&state->stats_work);
+		break;
+	case PM_POST_SUSPEND:
+	case PM_POST_HIBERNATION:
+		mutex_lock(&state->lock);
+		state->system_sleeping = false;
+		retune = state->pm_retune;
+		if (retune) {
+			state->retune_pending = true;
+			state->poll_fast = true;
+		}
+		mutex_unlock(&state->lock);
+		/* wake the frontend thread: it runs init, then our tune retunes */
+		if (retune)
+			dvb_frontend_reinitialise(&state->frontend);
+		break;
+	}
+	return NOTIFY_DONE;
+}
+
 static int sit2_drv_sleep(struct dvb_frontend *fe)
 {
 	struct sit2_state *state = fe->demodulator_priv;
 	
 	dprintk("%s: init=%d\n", __func__, state->isInited);
 	
-	sit2_demod_powerDown(state);
-	
-	sit2_demod_tuner_i2c_enable(state, 1);
-	sit2_tuner_xout_enable(state, 0);
-	sit2_tuner_standby(state);
-	sit2_demod_tuner_i2c_enable(state, 0);
-	
-	state->current_system = SYS_UNDEFINED;
+	atomic_inc(&state->tune_gen);
+	sit2_lock(state, SIT2_OP_SLEEP);
+	state->stats_running = false;
+	sit2_wd_reset(state);
+	if ((sit2_autosuspend_ms > 0) && !state->system_sleeping) {
+		state->suspend_pending = true;
+		schedule_delayed_work(&state->suspend_work,
+				msecs_to_jiffies(sit2_autosuspend_ms));
+	} else {
+		sit2_power_down(state);
+		state->pm_suspends++;
+	}
+	sit2_unlock(state);
+	return 0;
+}
+
+static int sit2_debugfs_pm_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "autosuspend_ms: %d\n", sit2_autosuspend_ms);
+	seq_printf(s, "suspend_pending: %d\n", state->suspend_pending);
+	seq_printf(s, "suspends: %u\n", state->pm_suspends);
+	seq_printf(s, "warm_resumes: %u\n", state->pm_warm_resumes);
+	seq_printf(s, "cold_resumes: %u\n", state->pm_cold_resumes);
+	seq_printf(s, "retunes: %u\n", state->pm_retunes);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_pm);
+
+static int sit2_debugfs_fw_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "valid: %d\n", state->fw_valid);
+	seq_printf(s, "romid: %d\n", state->fw_romid);
+	seq_printf(s, "part: Si21%02d-%c\n", state->fw_rev.pn, state->fw_rev.chiprev + '@');
+	seq_printf(s, "firmware: %d.%d patch %04x build %c.%c.%d\n",
+		   state->fw_rev.fwmajor, state->fw_rev.fwminor, state->fw_rev.patch,
+		   state->fw_rev.cmpmajor, state->fw_rev.cmpminor, state->fw_rev.cmpbuild);
+	seq_printf(s, "patch_crc: %08x\n", state->fw_crc);
+	seq_printf(s, "verified: %u\n", state->fw_verified);
+	seq_printf(s, "reloads: %u\n", state->fw_reloads);
+	seq_printf(s, "adopts: %u\n", state->fw_adopts);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_fw);
+
+static int sit2_debugfs_recovery_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "level: %d\n", state->recover_level);
+	seq_printf(s, "last_error: %d\n", state->last_error);
+	seq_printf(s, "err_i2c: %u\n", state->err_i2c);
+	seq_printf(s, "err_timeout: %u\n", state->err_timeout);
+	seq_printf(s, "err_cmd: %u\n", state->err_cmd);
+	seq_printf(s, "retries: %u\n", state->rec_retries);
+	seq_printf(s, "demod_restarts: %u\n", state->rec_restarts);
+	seq_printf(s, "tuner_inits: %u\n", state->rec_tuner_inits);
+	seq_printf(s, "warm_inits: %u\n", state->rec_warm_inits);
+	seq_printf(s, "cold_inits: %u\n", state->rec_cold_inits);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_recovery);
+
+static int sit2_debugfs_stats_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+
+	mutex_lock(&state->lock);
+	if (state->rssi_valid) {
+		seq_printf(s, "rssi_raw: %d dBm\n", state->tuner_status.rssi);
+		seq_printf(s, "rssi_band: %u\n", state->rssi_band);
+		seq_printf(s, "rssi: %d mdBm\n", state->rssi_mdbm);
+	} else {
+		seq_puts(s, "rssi: n/a\n");
+	}
+	seq_printf(s, "ber_window: 10^%u bits\n", state->ber_window);
+	seq_printf(s, "ber_windows: %u\n", state->ber_windows);
+	seq_printf(s, "ber_last: %u\n", state->ber_last);
+	seq_printf(s, "ber_errors: %llu\n", state->ber_errors);
+	seq_printf(s, "ber_bits: %llu\n", state->ber_bits);
+	seq_printf(s, "ucb_total: %llu\n", state->ucb_total);
+	if (state->quality_valid) {
+		seq_printf(s, "cnr: %u.%02u dB\n", state->quality_cnr / 4,
+			   (state->quality_cnr % 4) * 25);
+		seq_printf(s, "cnr_required: %u.%u dB\n", state->quality_req / 10,
+			   state->quality_req % 10);
+		seq_printf(s, "cnr_margin: %s%u.%u dB\n",
+			   (state->quality_margin < 0) ? "-" : "",
+			   abs(state->quality_margin) / 10, abs(state->quality_margin) % 10);
+		seq_printf(s, "quality: %u\n", state->quality_score);
+	} else {
+		seq_puts(s, "quality: n/a\n");
+	}
+	seq_printf(s, "dvbc_nosignal_aborts: %u\n", state->dvbc_nosignal_aborts);
+	seq_printf(s, "params_valid: %d\n", state->params_valid);
+	seq_printf(s, "params_reads: %u\n", state->params_reads);
+	seq_printf(s, "params_hits: %u\n", state->params_hits);
+	seq_printf(s, "rssi_floor: %d dBm\n", sit2_rssi_floor);
+	seq_printf(s, "rssi_floor_checks: %u\n", state->rssi_floor_checks);
+	seq_printf(s, "rssi_floor_skips: %u\n", state->rssi_floor_skips);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_stats);
+
+static int sit2_debugfs_ts_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "mode: %u\n", state->ts_mode);
+	seq_printf(s, "adapted: %d\n", state->ts_adapted);
+	seq_printf(s, "clock: %u0 kHz%s\n", state->ts_freq,
+		   state->ts_gapped ? " gapped" : "");
+	seq_printf(s, "bitrate: %u0 kbps\n", state->ts_bit_rate);
+	seq_printf(s, "chip_clock: %u0 kHz\n", state->dd_status.ts_clk_freq);
+	seq_printf(s, "adapts: %u\n", state->ts_adapts);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_ts);
+
+static int sit2_debugfs_watchdog_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "locked: %d\n", state->wd_locked);
+	seq_printf(s, "stage: %d\n", state->wd_stage);
+	seq_printf(s, "dropouts: %u\n", state->wd_dropouts);
+	seq_printf(s, "restarts: %u\n", state->wd_restarts);
+	seq_printf(s, "restart_relocks: %u\n", state->wd_restart_relocks);
+	seq_printf(s, "retunes: %u\n", state->wd_retunes);
+	seq_printf(s, "retune_relocks: %u\n", state->wd_retune_relocks);
+	seq_printf(s, "recover_ms_last: %u\n", state->wd_recover_ms_last);
+	seq_printf(s, "recover_ms_max: %u\n", state->wd_recover_ms_max);
+	seq_printf(s, "poll_ms: %u\n", state->poll_ms);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_watchdog);
+
+static int sit2_debugfs_bus_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+	struct sit2_op_stats *st;
+	int i;
+
+	seq_printf(s, "%-22s %8s %10s %10s %8s %8s %10s %10s\n", "op", "calls",
+		   "xfers", "bytes", "xfer/op", "byte/op", "us/op", "sleep/op");
+	mutex_lock(&state->lock);
+	for (i = 0; i < SIT2_OP_NUM; i++) {
+		st = &state->op_stats[i];
+		if (!st->calls)
+			continue;
+		seq_printf(s, "%-22s %8u %10llu %10llu %8llu %8llu %10llu %10llu\n",
+			   sit2_op_name[i], st->calls, st->xfers, st->bytes,
+			   div_u64(st->xfers, st->calls), div_u64(st->bytes, st->calls),
+			   div_u64(st->time_us, st->calls), div_u64(st->sleep_us, st->calls));
+	}
+	seq_printf(s, "\n%-22s %10s %8s\n", "command", "count", "errors");
+	for (i = 0; i < SIT2_CMD_NUM; i++) {
+		if (state->cmd_count[i])
+			seq_printf(s, "%-22s %10u %8u\n", sit2_cmd_desc[i].name,
+				   state->cmd_count[i], state->cmd_errors[i]);
+	}
+	mutex_lock(&state->gate_lock);
+	seq_printf(s, "\ntuner gate: %s, %s, %u switches\n",
+		   state->tuner_i2c ? "i2c mux" : "commands",
+		   state->gate_open ? "open" : "closed", state->gate_ops);
+	mutex_unlock(&state->gate_lock);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+
+static int sit2_debugfs_bus_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sit2_debugfs_bus_show, inode->i_private);
+}
+
+/* any write clears the counters */
+static ssize_t sit2_debugfs_bus_write(struct file *file, const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct sit2_state *state = ((struct seq_file *)file->private_data)->private;
+
+	mutex_lock(&state->lock);
+	memset(state->op_stats, 0, sizeof(state->op_stats));
+	memset(state->cmd_count, 0, sizeof(state->cmd_count));
+	memset(state->cmd_errors, 0, sizeof(state->cmd_errors));
+	mutex_lock(&state->gate_lock);
+	state->gate_ops = 0;
+	mutex_unlock(&state->gate_lock);
+	mutex_unlock(&state->lock);
+	return count;
+}
+
+static const struct file_operations sit2_debugfs_bus_fops = {
+	.owner		= THIS_MODULE,
+	.open		= sit2_debugfs_bus_open,
+	.read		= seq_read,
+	.write		= sit2_debugfs_bus_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* the capture file returns a snapshot of the ring taken at open */
+struct sit2_cap_snap {
+	u32 len;
+	u8 data[];
+};
+
+static int sit2_debugfs_capture_open(struct inode *inode, struct file *file)
+{
+	struct sit2_state *state = inode->i_private;
+	struct sit2_cap_snap *snap;
+
+	mutex_lock(&state->lock);
+	snap = vmalloc(sizeof(*snap) + state->cap_used);
+	if (!snap) {
+		mutex_unlock(&state->lock);
+		return -ENOMEM;
+	}
+	snap->len = state->cap_used;
+	if (state->cap_buf)
+		sit2_cap_get(state, state->cap_tail, snap->data, state->cap_used);
+	mutex_unlock(&state->lock);
+	file->private_data = snap;
+	return 0;
+}
+
+static ssize_t sit2_debugfs_capture_read(struct file *file, char __user *buf,
+					 size_t count, loff_t *ppos)
+{
+	struct sit2_cap_snap *snap = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, snap->data, snap->len);
+}
+
+static int sit2_debugfs_capture_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations sit2_debugfs_capture_fops = {
+	.owner		= THIS_MODULE,
+	.open		= sit2_debugfs_capture_open,
+	.read		= sit2_debugfs_capture_read,
+	.release	= sit2_debugfs_capture_release,
+};
+
+static int sit2_debugfs_capture_ctl_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "capture: %d\n", state->cap_on);
+	seq_printf(s, "records: %u\n", state->cap_records);
+	seq_printf(s, "bytes: %u\n", state->cap_used);
+	seq_printf(s, "drops: %u\n", state->cap_drops);
+	seq_printf(s, "replay: %d\n", state->replay_on);
+	seq_printf(s, "replay_pos: %u/%u\n", state->replay_pos, state->replay_len);
+	seq_printf(s, "replay_mismatch: %u\n", state->replay_mismatch);
+	seq_printf(s, "replay_vclock_ms: %llu\n", div_u64(state->vclock_us, 1000));
+	mutex_unlock(&state->lock);
+	return 0;
+}
+
+static int sit2_debugfs_capture_ctl_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sit2_debugfs_capture_ctl_show, inode->i_private);
+}
+
+/* "capture" restarts recording, "replay" rewinds and arms replay, "stop" ends both */
+static ssize_t sit2_debugfs_capture_ctl_write(struct file *file, const char __user *buf,
+					      size_t count, loff_t *ppos)
+{
+	struct sit2_state *state = ((struct seq_file *)file->private_data)->private;
+	char cmd[16];
+	int ret = count;
+
+	if (count >= sizeof(cmd))
+		return -EINVAL;
+	if (copy_from_user(cmd, buf, count))
+		return -EFAULT;
+	cmd[count] = 0;
+	strim(cmd);
+
+	mutex_lock(&state->lock);
+	if (!strcmp(cmd, "capture")) {
+		if (!state->cap_buf)
+			state->cap_buf = vmalloc(SIT2_CAPTURE_SIZE);
+		if (state->cap_buf) {
+			state->cap_head = state->cap_tail = state->cap_used = 0;
+			state->cap_records = state->cap_drops = 0;
+			state->cap_start = sit2_now(state);
+			state->cap_on = true;
+		} else
+			ret = -ENOMEM;
+	} else if (!strcmp(cmd, "replay")) {
+		state->replay_pos = 0;
+		state->replay_mismatch = 0;
+		/* timestamps from before would depend on when the replay starts */
+		state->vclock_base = ktime_get();
+		state->stats_time = 0;
+		state->poll_locked = false;
+		state->recover_level = SIT2_RECOVER_NONE;
+		sit2_wd_reset(state);
+		state->replay_on = (state->replay_len > 0);
+	} else if (!strcmp(cmd, "stop")) {
+		state->cap_on = false;
+		state->replay_on = false;
+	} else
+		ret = -EINVAL;
+	mutex_unlock(&state->lock);
+	return ret;
+}
+
+static const struct file_operations sit2_debugfs_capture_ctl_fops = {
+	.owner		= THIS_MODULE,
+	.open		= sit2_debugfs_capture_ctl_open,
+	.read		= seq_read,
+	.write		= sit2_debugfs_capture_ctl_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* load a capture to replay, writing at offset 0 starts a new one */
+static ssize_t sit2_debugfs_replay_write(struct file *file, const char __user *buf,
+					 size_t count, loff_t *ppos)
+{
+	struct sit2_state *state = file->private_data;
+	int ret = count;
+
+	if (*ppos + count > SIT2_REPLAY_SIZE)
+		return -ENOSPC;
+	mutex_lock(&state->lock);
+	if (!state->replay_buf)
+		state->replay_buf = vmalloc(SIT2_REPLAY_SIZE);
+	if (!state->replay_buf) {
+		ret = -ENOMEM;
+	} else {
+		if (*ppos == 0) {
+			state->replay_on = false;
+			state->replay_len = 0;
+		}
+		if (copy_from_user(state->replay_buf + *ppos, buf, count)) {
+			ret = -EFAULT;
+		} else {
+			*ppos += count;
+			state->replay_len = *ppos;
+		}
+	}
+	mutex_unlock(&state->lock);
+	return ret;
+}
+
+static const struct file_operations sit2_debugfs_replay_fops = {
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.write		= sit2_debugfs_replay_write,
+};
+
+static const char *sit2_scan_sys_name(u8 modulation)
+{
+	switch (modulation) {
+	case 2:
+		return "t";
+	case 7:
+		return "t2";
+	case 3:
+		return "c";
+	}
+	return "-";
+}
+
+static int sit2_debugfs_scan_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+	struct sit2_scan_result *res;
+	u32 i;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "%-4s %10s %8s %6s %4s %4s %4s %6s %7s\n", "sys", "frequency",
+		   "rate", "stream", "lock", "det", "plps", "cnr", "lock_ms");
+	for (i = 0; i < state->scan_num; i++) {
+		res = &state->scan_res[i];
+		seq_printf(s, "%-4s %10u %8u %6d %4u %4s %4u %3u.%02u %7u\n",
+			   (res->system == SYS_DVBC_ANNEX_A) ? "c" :
+			   (res->system == SYS_DVBT2) ? "t2" : "t",
+			   res->frequency, res->rate, res->stream, res->lock,
+			   res->lock ? sit2_scan_sys_name(res->detected) : "-",
+			   res->num_plp, res->cnr / 4, (res->cnr % 4) * 25,
+			   res->lock_ms);
+	}
+	seq_printf(s, "\nscanning: %d\nscans: %u\nstopped: %u\n", state->scanning,
+		   state->scans, state->scan_stops);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+
+static int sit2_debugfs_scan_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sit2_debugfs_scan_show, inode->i_private);
+}
+
+/*
+ * one "<t|t2|c> <frequency> <bandwidth|symbol rate> [stream]" per line, all Hz,
+ * lines without the three fields are skipped; returns the number of entries
+ */
+static int sit2_scan_parse(char *text, struct sit2_scan_result *res)
+{
+	char *p = text, *line, sys[4];
+	int stream, num = 0;
+
+	while ((line = strsep(&p, "\n")) && (num < SIT2_SCAN_MAX)) {
+		stream = -1;
+		if (sscanf(line, "%3s %u %u %d", sys, &res[num].frequency,
+			   &res[num].rate, &stream) < 3)
+			continue;
+		if (!strcmp(sys, "t"))
+			res[num].system = SYS_DVBT;
+		else if (!strcmp(sys, "t2"))
+			res[num].system = SYS_DVBT2;
+		else if (!strcmp(sys, "c"))
+			res[num].system = SYS_DVBC_ANNEX_A;
+		else
+			return -EINVAL;
+		res[num].stream = clamp(stream, -1, 255);
+		num++;
+	}
+	return num ? num : -EINVAL;
+}
+
+/*
+ * a scan list as sit2_scan_parse takes it, or "cancel" to stop a running
+ * scan after its current entry
+ */
+static ssize_t sit2_debugfs_scan_write(struct file *file, const char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	struct sit2_state *state = ((struct seq_file *)file->private_data)->private;
+	struct sit2_scan_result *res;
+	int num, done, ret = count;
+	char *text;
+
+	if (count > SIT2_SCAN_MAX * 48)
+		return -EINVAL;
+	text = memdup_user_nul(buf, count);
+	if (IS_ERR(text))
+		return PTR_ERR(text);
+	if (!strcmp(strim(text), "cancel")) {
+		atomic_inc(&state->tune_gen);
+		kfree(text);
+		return count;
+	}
+	res = kcalloc(SIT2_SCAN_MAX, sizeof(*res), GFP_KERNEL);
+	if (!res) {
+		kfree(text);
+		return -ENOMEM;
+	}
+
+	num = sit2_scan_parse(text, res);
+	if (num < 0) {
+		ret = num;
+		goto out;
+	}
+
+	done = sit2_scan(state, res, num);
+	if (done < 0) {
+		ret = done;
+		goto out;
+	}
+	mutex_lock(&state->lock);
+	kfree(state->scan_res);
+	state->scan_res = res;
+	state->scan_num = done;
+	res = NULL;
+	mutex_unlock(&state->lock);
+out:
+	kfree(res);
+	kfree(text);
+	return ret;
+}
+
+static const struct file_operations sit2_debugfs_scan_fops = {
+	.owner		= THIS_MODULE,
+	.open		= sit2_debugfs_scan_open,
+	.read		= seq_read,
+	.write		= sit2_debugfs_scan_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int sit2_debugfs_t2_l1_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+	SIT2_T2_PLP_INFO *plp;
+	u8 i;
+
+	sit2_lock(state, SIT2_OP_T2_L1);
+	if (!state->params_valid || (state->params.system != 7)) {
+		seq_puts(s, "no T2 lock\n");
+		goto out;
+	}
+	/* only read when asked for, a tune does not need it */
+	if (!state->t2_l1_valid)
+		sit2_t2_read_l1(state);
+	if (!state->t2_l1_valid) {
+		seq_puts(s, "L1 read failed\n");
+		goto out;
+	}
+	if (state->t2_tx_id.available)
+		seq_printf(s, "cell_id: 0x%04x\nnetwork_id: 0x%04x\nt2_system_id: 0x%04x\n",
+			   state->t2_tx_id.cell_id, state->t2_tx_id.network_id,
+			   state->t2_tx_id.t2_system_id);
+	seq_printf(s, "fef: type %u length %u repetition %u\n", state->t2_fef.fef_type,
+		   state->t2_fef.fef_length, state->t2_fef.fef_repetition);
+	seq_printf(s, "plps: %u\n", state->t2_plp_num);
+	seq_printf(s, "%4s %4s %7s %5s %3s %3s %3s %3s\n", "id", "type",
+		   "payload", "group", "cod", "mod", "rot", "fec");
+	for (i = 0; i < state->t2_plp_num; i++) {
+		plp = &state->t2_plp[i];
+		seq_printf(s, "%4u %4u %7u %5u %3u %3u %3u %3u\n", plp->plp_id,
+			   plp->plp_type, plp->payload_type, plp->group_id,
+			   plp->cod, plp->mod, plp->rot, plp->fec_type);
+	}
+out:
+	sit2_unlock(state);
 	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_t2_l1);
+
+static int sit2_debugfs_lock_model_show(struct seq_file *s, void *data)
+{
+	static const char * const sys[] = { "t", "t2", "c" };
+	struct sit2_state *state = s->private;
+	struct sit2_lock_stat *st;
+	int i;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "window: %u..%u ms\n", state->lock_min_ms, state->lock_max_ms);
+	seq_printf(s, "last: %u ms\n", state->lock_last_ms);
+	seq_printf(s, "timeouts: %u\n", state->lock_timeouts);
+	seq_printf(s, "%-3s %4s %7s %6s %6s %6s %8s %6s\n", "sys", "mode", "samples",
+		   "avg", "best", "worst", "timeouts", "extend");
+	for (i = 0; i < SIT2_LOCK_BUCKETS; i++) {
+		st = &state->lock_stat[i];
+		if (!st->samples && !st->timeouts)
+			continue;
+		seq_printf(s, "%-3s %4d %7u %6u %6u %6u %8u %6u\n", sys[i / SIT2_LOCK_MODES],
+			   i % SIT2_LOCK_MODES, st->samples, st->avg_ms,
+			   st->best_ms, st->worst_ms, st->timeouts, st->extend_ms);
+	}
+	mutex_unlock(&state->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_lock_model);
+
+static int sit2_debugfs_dvbc_auto_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+	int i;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "runs: %u\n", state->dvbc_auto_runs);
+	seq_printf(s, "tries: %u\n", state->dvbc_auto_tries);
+	seq_printf(s, "locks: %u\n", state->dvbc_auto_locks);
+	for (i = 0; i < SIT2_DVBC_CANDS; i++)
+		seq_printf(s, "%d: %u sym/s qam %d\n", i,
+			   state->dvbc_cand[i].symbol_rate,
+			   state->dvbc_cand[i].modulation);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_dvbc_auto);
+
+/* upper bound of the bucket holding the pct'th percentile, in us */
+static u32 sit2_lat_percentile(const struct sit2_op_stats *st, u32 pct)
+{
+	u64 total = 0, sum = 0;
+	int i;
+
+	for (i = 0; i < SIT2_LAT_BUCKETS; i++)
+		total += st->lat_hist[i];
+	total = DIV_ROUND_UP(total * pct, 100);
+	for (i = 0; i < SIT2_LAT_BUCKETS - 1; i++) {
+		sum += st->lat_hist[i];
+		if (sum >= total)
+			break;
+	}
+	return 1U << i;
+}
+
+/* cleared together with the bus counters */
+static int sit2_debugfs_latency_show(struct seq_file *s, void *data)
+{
+	struct sit2_state *state = s->private;
+	struct sit2_op_stats *st;
+	u64 xfers = 0;
+	int i;
+
+	seq_printf(s, "%-22s %8s %10s %10s %10s %10s\n", "op", "calls",
+		   "wait/op", "p50", "p90", "p99");
+	mutex_lock(&state->lock);
+	for (i = 0; i < SIT2_OP_NUM; i++) {
+		st = &state->op_stats[i];
+		xfers += st->xfers;
+		if (!st->calls)
+			continue;
+		seq_printf(s, "%-22s %8u %10llu %10u %10u %10u\n",
+			   sit2_op_name[i], st->calls, div_u64(st->wait_us, st->calls),
+			   sit2_lat_percentile(st, 50), sit2_lat_percentile(st, 90),
+			   sit2_lat_percentile(st, 99));
+	}
+	seq_printf(s, "\nxfers: %llu\n", xfers);
+	mutex_unlock(&state->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(sit2_debugfs_latency);
+
+static void sit2_debugfs_init(struct sit2_state *state)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "sit2-%d-%02x",
+		 i2c_adapter_id(state->i2c), state->demod_addr);
+	state->debugfs_dir = debugfs_create_dir(name, NULL);
+	debugfs_create_file("pm", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_pm_fops);
+	debugfs_create_file("fw", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_fw_fops);
+	debugfs_create_file("recovery", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_recovery_fops);
+	debugfs_create_file("stats", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_stats_fops);
+	debugfs_create_file("ts", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_ts_fops);
+	debugfs_create_file("watchdog", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_watchdog_fops);
+	debugfs_create_file("scan", 0600, state->debugfs_dir, state,
+			    &sit2_debugfs_scan_fops);
+	debugfs_create_file("t2_l1", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_t2_l1_fops);
+	debugfs_create_file("lock_model", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_lock_model_fops);
+	debugfs_create_file("dvbc_auto", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_dvbc_auto_fops);
+	debugfs_create_file("latency", 0444, state->debugfs_dir, state,
+			    &sit2_debugfs_latency_fops);
+	debugfs_create_file("bus", 0644, state->debugfs_dir, state,
+			    &sit2_debugfs_bus_fops);
+	debugfs_create_file("capture", 0400, state->debugfs_dir, state,
+			    &sit2_debugfs_capture_fops);
+	debugfs_create_file("capture_ctl", 0600, state->debugfs_dir, state,
+			    &sit2_debugfs_capture_ctl_fops);
+	debugfs_create_file("replay", 0200, state->debugfs_dir, state,
+			    &sit2_debugfs_replay_fops);
+}
 
 static void sit2_drv_release(struct dvb_frontend *fe)
 {
 	struct sit2_state *state = fe->demodulator_priv;
+	unregister_pm_notifier(&state->pm_nb);
+	cancel_delayed_work_sync(&state->suspend_work);
+	/* the autosuspend will not run any more, do its job now */
+	sit2_lock(state, SIT2_OP_SLEEP);
+	if (state->suspend_pending) {
+		sit2_power_down(state);
+		state->pm_suspends++;
+	}
+	sit2_unlock(state);
+	state->stats_running = false;
+	cancel_delayed_work_sync(&state->stats_work);
+	debugfs_remove_recursive(state->debugfs_dir);
+	vfree(state->cap_buf);
+	vfree(state->replay_buf);
+	kfree(state->scan_res);
+	kfree(state->fw_dma);
+#ifdef SIT2_I2C_MUX
+	if (state->muxc) {
+		i2c_mux_del_adapters(state->muxc);
+		/* devm of the parent adapter, which outlives this frontend */
+		devm_kfree(&state->i2c->dev, state->muxc);
+	}
+#endif
+	kfree(state->sndBuffer);
 	kfree(state);
 }
 
+/*
+ * Put the tuner on a child adapter of its own. There is no i2c_client for
+ * the demod, so the mux hangs off the parent adapter's device. If this
+ * fails, the tuner is reached with explicit gate commands as before.
+ */
+static void sit2_mux_init(struct sit2_state *state)
+{
+#ifdef SIT2_I2C_MUX
+	int ret;
+	state->muxc = i2c_mux_alloc(state->i2c, &state->i2c->dev, 1, 0,
+				    I2C_MUX_LOCKED, sit2_mux_select,
+				    sit2_mux_deselect);
+	if (!state->muxc)
+		return;
+	state->muxc->priv = state;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+	ret = i2c_mux_add_adapter(state->muxc, 0, 0);
+#else
+	ret = i2c_mux_add_adapter(state->muxc, 0, 0, 0);
+#endif
+	if (ret) {
+		dev_warn(&state->i2c->dev, "%s: tuner i2c mux failed (%d)\n",
+			 KBUILD_MODNAME, ret);
+		devm_kfree(&state->i2c->dev, state->muxc);
+		state->muxc = NULL;
+		return;
+	}
+	state->tuner_i2c = state->muxc->adapter[0];
+#endif
+}
+
 static const struct dvb_frontend_ops sit2_ops = {
 	.delsys = { SYS_DVBT, SYS_DVBT2, SYS_DVBC_ANNEX_A },
 	/*.delsys = { SYS_DVBC_ANNEX_A },*/
@@ -1269,6 +4001,14 @@ struct dvb_frontend *sit2_attach(const struct sit2_config *config,
 				KBUILD_MODNAME);
 		goto error;
 	}	
+	state->sndBuffer = kzalloc(3 * SIT2_CMDBUF_SIZE, GFP_KERNEL);
+	if (!state->sndBuffer) {
+		dev_err(&i2c->dev, "%s: kzalloc() failed\n",
+				KBUILD_MODNAME);
+		goto error;
+	}
+	state->revBuffer = state->sndBuffer + SIT2_CMDBUF_SIZE;
+	state->gateBuffer = state->revBuffer + SIT2_CMDBUF_SIZE;
 	state->config = config;
 	state->i2c = i2c;
 	state->isInited = false;
@@ -1277,17 +4017,35 @@ struct dvb_frontend *sit2_attach(const struct sit2_config *config,
 	state->plp_id = 0;
 	state->current_system = SYS_UNDEFINED;
 	state->stream = 0;
+	state->pm_system = SYS_UNDEFINED;
+	memcpy(state->dvbc_cand, sit2_dvbc_cand_default, sizeof(state->dvbc_cand));
+	sit2_ts_config(state);
+	state->t2_fef_arg = SIT2_FEF_TUNER_FLAG;
+	mutex_init(&state->lock);
+	mutex_init(&state->gate_lock);
+	sit2_mux_init(state);
+	INIT_DELAYED_WORK(&state->suspend_work, sit2_suspend_work);
+	INIT_DELAYED_WORK(&state->stats_work, sit2_stats_work);
+	state->pm_nb.notifier_call = sit2_pm_notify;
+	register_pm_notifier(&state->pm_nb);
+	sit2_debugfs_init(state);
 	
 	memcpy(&state->frontend.ops, &sit2_ops,
 	       sizeof(struct dvb_frontend_ops));
 	state->frontend.demodulator_priv = state;
 	return &state->frontend;
 error:
+	if (state)
+		kfree(state->sndBuffer);
 	kfree(state);
 	return NULL;
 }
 EXPORT_SYMBOL(sit2_attach);
 
+#if IS_ENABLED(CONFIG_DVB_SIT2_KUNIT_TEST)
+#include "sit2_test.c"
+#endif
+
 MODULE_DESCRIPTION("sit2 demodulator driver");
 MODULE_AUTHOR("Max Nibble <nibble.max@gmail.com>");
 MODULE_LICENSE("GPL");
@@ -12,6 +12,7 @@
 #define SIT2_ERROR_TIMEOUT	0x01
 #define SIT2_ERROR_POLLING	0x02
 #define SIT2_ERROR_PAREMETER	0x03
+#define SIT2_ERROR_I2C		0x04
 #define SIT2_ERROR_ERR		0xfe
 #define SIT2_ERROR_UNKNOWN	0xff
 
@@ -55,6 +56,211 @@ typedef struct {
 	u32 ts_clk_freq;
 }SIT2_DD_STATUS;
 
+typedef struct {
+	u8 pcl;
+	u8 dl;
+	u8 ber;
+	u8 uncor;
+	u8 cnr;			/* 0.25 dB */
+	s16 afc_freq;
+	s16 timing_offset;
+	u8 constellation;
+	u8 sp_inv;
+	u8 rate_hp;
+	u8 rate_lp;
+	u8 fft_mode;
+	u8 guard_int;
+	u8 hierarchy;
+}SIT2_DVBT_STATUS;
+
+typedef struct {
+	u8 pcl;
+	u8 dl;
+	u8 ber;
+	u8 uncor;
+	u8 cnr;			/* 0.25 dB */
+	s16 afc_freq;
+	s16 timing_offset;
+	u8 constellation;
+	u8 sp_inv;
+	u8 fft_mode;
+	u8 guard_int;
+	u8 num_plp;
+	u8 pilot_pattern;
+	u8 rotated;
+	u8 code_rate;
+	u8 t2_version;
+}SIT2_DVBT2_STATUS;
+
+typedef struct {
+	u8 pcl;
+	u8 dl;
+	u8 ber;
+	u8 uncor;
+	u8 cnr;			/* 0.25 dB */
+	s16 afc_freq;
+	s16 timing_offset;
+	u8 constellation;
+	u8 sp_inv;
+}SIT2_DVBC_STATUS;
+
+/* DVB-T2 L1 signalling */
+typedef struct {
+	u8 plp_id;
+	u8 plp_type;		/* 0: common, 1: data type 1, 2: data type 2 */
+	u8 payload_type;	/* 0: GFPS, 1: GCS, 2: GSE, 3: TS */
+	u8 group_id;
+	u8 cod;			/* code rate, DVBT2_STATUS coding */
+	u8 mod;			/* constellation, DVBT2_STATUS coding */
+	u8 rot;
+	u8 fec_type;		/* 0: 16K LDPC, 1: 64K LDPC */
+}SIT2_T2_PLP_INFO;
+
+typedef struct {
+	u8 available;
+	u16 cell_id;
+	u16 network_id;
+	u16 t2_system_id;
+}SIT2_T2_TX_ID;
+
+typedef struct {
+	u8 fef_type;
+	u32 fef_length;
+	u32 fef_repetition;
+}SIT2_T2_FEF;
+
+typedef struct {
+	u8 exp;
+	u8 mant;		/* ber = mant/10 * 10^-exp */
+}SIT2_BER;
+
+typedef struct {
+	u16 errors;		/* uncorrectable packets since last reset */
+}SIT2_UNCOR;
+
+typedef struct {
+	u8 tc;
+	u8 rssil;
+	u8 rssih;
+	s8 rssi;		/* dBm */
+	u32 freq;
+	u8 mode;
+}SIT2_TUNER_STATUS;
+
+typedef struct {
+	u8 pn;
+	u8 fwmajor;
+	u8 fwminor;
+	u16 patch;
+	u8 cmpmajor;
+	u8 cmpminor;
+	u8 cmpbuild;
+	u8 chiprev;
+}SIT2_FW_REV;
+
+/* command descriptors, indexed by SIT2_CMD_* */
+#define SIT2_CMD_F_TUNER	0x01	/* sent to the tuner, not the demod */
+#define SIT2_CMD_F_IDEMPOTENT	0x02	/* can be resent after a bus error */
+#define SIT2_CMD_F_ARG_ACK	0x04	/* arg bit 0 acks/clears, not resendable then */
+
+enum sit2_cmd {
+	SIT2_CMD_TUNER_POWER_UP = 0,
+	SIT2_CMD_TUNER_XOUT,
+	SIT2_CMD_TUNER_START_FW,
+	SIT2_CMD_TUNER_CONFIG_PINS,
+	SIT2_CMD_TUNER_SET_PROPERTY,
+	SIT2_CMD_TUNER_STANDBY,
+	SIT2_CMD_TUNER_TUNE,
+	SIT2_CMD_TUNER_STATUS,
+	SIT2_CMD_START_CLK,
+	SIT2_CMD_POWER_UP,
+	SIT2_CMD_I2C_PASSTHROUGH,
+	SIT2_CMD_START_FW,
+	SIT2_CMD_PART_INFO,
+	SIT2_CMD_GET_REV,
+	SIT2_CMD_CONFIG_PINS,
+	SIT2_CMD_POWER_DOWN,
+	SIT2_CMD_SET_PROPERTY,
+	SIT2_CMD_DD_BER,
+	SIT2_CMD_DD_UNCOR,
+	SIT2_CMD_DD_RESTART,
+	SIT2_CMD_DD_STATUS,
+	SIT2_CMD_DD_MP_DEFAULTS,
+	SIT2_CMD_DD_EXT_AGC_TER,
+	SIT2_CMD_DVBT2_STATUS,
+	SIT2_CMD_DVBT2_FEF,
+	SIT2_CMD_DVBT2_FEF_INFO,
+	SIT2_CMD_DVBT2_PLP_SELECT,
+	SIT2_CMD_DVBT2_PLP_INFO,
+	SIT2_CMD_DVBT2_TX_ID,
+	SIT2_CMD_DVBC_STATUS,
+	SIT2_CMD_DVBT_STATUS,
+	SIT2_CMD_NUM
+};
+
+typedef struct {
+	const char *name;
+	u8 opcode;
+	u8 flags;
+	u8 txLen;
+	u8 rxLen;	/* 0: no response is read */
+	u8 typMs;	/* typical time to CTS */
+}SIT2_CMD_DESC;
+
+#define SIT2_T		SIT2_CMD_F_TUNER
+#define SIT2_I		SIT2_CMD_F_IDEMPOTENT
+#define SIT2_A		(SIT2_CMD_F_IDEMPOTENT | SIT2_CMD_F_ARG_ACK)
+
+static const SIT2_CMD_DESC sit2_cmd_desc[SIT2_CMD_NUM] = {
+	/*				   name              op    flags         tx  rx  ms */
+	[SIT2_CMD_TUNER_POWER_UP]	= { "TUNER_POWER_UP",   0xc0, SIT2_T,        15,  1, 10 },
+	[SIT2_CMD_TUNER_XOUT]		= { "TUNER_XOUT",       0xc0, SIT2_T,         3,  1,  1 },
+	[SIT2_CMD_TUNER_START_FW]	= { "TUNER_START_FW",   0x01, SIT2_T,         2,  1, 20 },
+	[SIT2_CMD_TUNER_CONFIG_PINS]	= { "TUNER_CONFIG_PINS", 0x12, SIT2_T,        6,  6,  1 },
+	[SIT2_CMD_TUNER_SET_PROPERTY]	= { "TUNER_SET_PROP",   0x14, SIT2_T|SIT2_I,  6,  4,  1 },
+	[SIT2_CMD_TUNER_STANDBY]	= { "TUNER_STANDBY",    0x16, SIT2_T,         2,  1,  1 },
+	[SIT2_CMD_TUNER_TUNE]		= { "TUNER_TUNE",       0x41, SIT2_T|SIT2_I,  8,  1,  1 },
+	[SIT2_CMD_TUNER_STATUS]		= { "TUNER_STATUS",     0x42, SIT2_T|SIT2_A,  2, 12,  1 },
+	[SIT2_CMD_START_CLK]		= { "START_CLK",        0xc0, 0,             13,  0,  0 },
+	[SIT2_CMD_POWER_UP]		= { "POWER_UP",         0xc0, 0,              8,  1, 10 },
+	[SIT2_CMD_I2C_PASSTHROUGH]	= { "I2C_PASSTHROUGH",  0xc0, SIT2_I,         3,  0,  0 },
+	[SIT2_CMD_START_FW]		= { "START_FW",         0x01, 0,              2,  1, 20 },
+	[SIT2_CMD_PART_INFO]		= { "PART_INFO",        0x02, SIT2_I,         1, 13,  1 },
+	[SIT2_CMD_GET_REV]		= { "GET_REV",          0x11, SIT2_I,         1, 10,  1 },
+	[SIT2_CMD_CONFIG_PINS]		= { "CONFIG_PINS",      0x12, 0,              3,  3,  1 },
+	[SIT2_CMD_POWER_DOWN]		= { "POWER_DOWN",       0x13, 0,              1,  0,  0 },
+	[SIT2_CMD_SET_PROPERTY]		= { "SET_PROPERTY",     0x14, SIT2_I,         6,  4,  1 },
+	[SIT2_CMD_DD_BER]		= { "DD_BER",           0x82, SIT2_A,         2,  3,  1 },
+	[SIT2_CMD_DD_UNCOR]		= { "DD_UNCOR",         0x84, SIT2_A,         2,  3,  1 },
+	[SIT2_CMD_DD_RESTART]		= { "DD_RESTART",       0x85, SIT2_I,         1,  1,  5 },
+	[SIT2_CMD_DD_STATUS]		= { "DD_STATUS",        0x87, SIT2_A,         2,  8,  1 },
+	[SIT2_CMD_DD_MP_DEFAULTS]	= { "DD_MP_DEFAULTS",   0x88, SIT2_I,         5,  5,  1 },
+	[SIT2_CMD_DD_EXT_AGC_TER]	= { "DD_EXT_AGC_TER",   0x89, SIT2_I,         6,  3,  1 },
+	[SIT2_CMD_DVBT2_STATUS]		= { "DVBT2_STATUS",     0x50, SIT2_A,         2, 14,  1 },
+	[SIT2_CMD_DVBT2_FEF]		= { "DVBT2_FEF",        0x51, SIT2_I,         2, 12,  1 },
+	[SIT2_CMD_DVBT2_FEF_INFO]	= { "DVBT2_FEF_INFO",   0x51, SIT2_I,         2, 12,  1 },
+	[SIT2_CMD_DVBT2_PLP_SELECT]	= { "DVBT2_PLP_SELECT", 0x52, SIT2_I,         3,  1,  1 },
+	[SIT2_CMD_DVBT2_PLP_INFO]	= { "DVBT2_PLP_INFO",   0x53, SIT2_I,         2, 13,  1 },
+	[SIT2_CMD_DVBT2_TX_ID]		= { "DVBT2_TX_ID",      0x54, SIT2_I,         1,  8,  1 },
+	[SIT2_CMD_DVBC_STATUS]		= { "DVBC_STATUS",      0x90, SIT2_A,         2,  9,  1 },
+	[SIT2_CMD_DVBT_STATUS]		= { "DVBT_STATUS",      0xa0, SIT2_A,         2, 13,  1 },
+};
+
+#undef SIT2_T
+#undef SIT2_I
+#undef SIT2_A
+
+/* i2c capture record, followed by len payload bytes, little endian */
+#define SIT2_CAP_READ		0x01
+#define SIT2_CAP_ERROR		0x02
+
+struct sit2_cap_rec {
+	__le32 ts_us;	/* since capture start */
+	u8 addr;
+	u8 flags;
+	__le16 len;
+} __packed;
+
 unsigned char sit2_patch_2[] = {
 0x04,0x01,0x00,0x00,0x00,0x00,0x6E,0x22,
 0x05,0x8A,0xC7,0x3F,0x6A,0x43,0x27,0x94,
@@ -0,0 +1,846 @@
+/*
+    SIT2  - Si2168/Si2158 protocol simulator
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+/*
+ * An i2c adapter with a model of the demod and tuner behind it: command
+ * and CTS handshake, property storage, ROM id and patch download, the
+ * tuner pass-through, tunint/dtvint timing and the demod acquisition of
+ * a configurable list of multiplexes. sit2_attach() is pointed at the
+ * adapter instead of a real bus.
+ */
+#include <linux/delay.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/i2c.h>
+#include <linux/ktime.h>
+#include "dvb_frontend.h"
+#include "sit2_sim.h"
+
+#define SIT2_SIM_DEMOD_ADDR	0x64
+#define SIT2_SIM_TUNER_ADDR	0x60
+
+#define SIT2_SIM_CTS		0x80
+#define SIT2_SIM_ERR		0x40
+
+#define SIT2_SIM_DD_PCL		0x02
+#define SIT2_SIM_DD_DL		0x04
+#define SIT2_SIM_DD_BER		0x08
+#define SIT2_SIM_DD_NOSIG	0x20
+
+#define SIT2_SIM_TUNINT		0x01
+#define SIT2_SIM_DTVINT		0x04
+
+static int sit2_sim_cmd_us = 300;
+module_param(sit2_sim_cmd_us, int, 0644);
+MODULE_PARM_DESC(sit2_sim_cmd_us, "Default time from a command to CTS, in us (default:300)");
+
+static int sit2_sim_tune_us = 25000;
+module_param(sit2_sim_tune_us, int, 0644);
+MODULE_PARM_DESC(sit2_sim_tune_us, "Default tuner tune time to tunint, in us (default:25000)");
+
+static int sit2_sim_bus_khz = 400;
+module_param(sit2_sim_bus_khz, int, 0644);
+MODULE_PARM_DESC(sit2_sim_bus_khz, "Default modelled bus clock, 0 for free transfers (default:400)");
+
+static const struct sit2_sim_timing sit2_sim_timing_default = {
+	.cmd_us		= 300,
+	.power_up_us	= 8000,
+	.start_fw_us	= 15000,
+	.patch_line_us	= 100,
+	.restart_us	= 3000,
+	.tune_us	= 25000,
+	.dtv_us		= 4000,
+	.nosignal_ms	= 250,
+	.fail_ms	= 1000,
+	.bus_khz	= 400,
+};
+
+static ktime_t sit2_sim_now(struct sit2_sim *sim)
+{
+	return sim->now ? sim->now(sim->clock_priv) : ktime_get();
+}
+
+static ktime_t sit2_sim_later(ktime_t a, ktime_t b)
+{
+	return ktime_before(a, b) ? b : a;
+}
+
+/* bus time of one message: start, address and 9 clocks per byte */
+static void sit2_sim_bus_time(struct sit2_sim *sim, u16 len)
+{
+	u32 us;
+
+	if (!sim->timing.bus_khz)
+		return;
+	us = DIV_ROUND_UP((len + 1) * 9000 + 2000, sim->timing.bus_khz);
+	sim->stats.bus_us += us;
+	if (sim->delay)
+		sim->delay(sim->clock_priv, us);
+	else if (us >= 20)
+		usleep_range(us, us + us / 8);
+	else
+		udelay(us);
+}
+
+/* chip codes, as the demod reports them */
+static u8 sit2_sim_qam_code(fe_modulation_t m)
+{
+	switch (m) {
+	case QPSK:	return 3;
+	case QAM_16:	return 7;
+	case QAM_32:	return 8;
+	case QAM_64:	return 9;
+	case QAM_128:	return 10;
+	case QAM_256:	return 11;
+	default:	return 0;
+	}
+}
+
+static u8 sit2_sim_qam_bits(fe_modulation_t m)
+{
+	switch (m) {
+	case QPSK:	return 2;
+	case QAM_16:	return 4;
+	case QAM_32:	return 5;
+	case QAM_64:	return 6;
+	case QAM_128:	return 7;
+	default:	return 8;
+	}
+}
+
+static u32 sit2_sim_fft(fe_transmit_mode_t t)
+{
+	switch (t) {
+	case TRANSMISSION_MODE_1K:	return 1024;
+	case TRANSMISSION_MODE_2K:	return 2048;
+	case TRANSMISSION_MODE_4K:	return 4096;
+	case TRANSMISSION_MODE_16K:	return 16384;
+	case TRANSMISSION_MODE_32K:	return 32768;
+	default:			return 8192;
+	}
+}
+
+static u8 sit2_sim_fft_code(fe_transmit_mode_t t)
+{
+	switch (t) {
+	case TRANSMISSION_MODE_1K:	return 10;
+	case TRANSMISSION_MODE_2K:	return 11;
+	case TRANSMISSION_MODE_4K:	return 12;
+	case TRANSMISSION_MODE_16K:	return 14;
+	case TRANSMISSION_MODE_32K:	return 15;
+	default:			return 13;
+	}
+}
+
+/* guard interval code and length in 1/256 of the useful symbol */
+static u8 sit2_sim_gi_code(fe_guard_interval_t g, u32 *gi_256)
+{
+	switch (g) {
+	case GUARD_INTERVAL_1_32:	*gi_256 = 8;	return 1;
+	case GUARD_INTERVAL_1_16:	*gi_256 = 16;	return 2;
+	case GUARD_INTERVAL_1_8:	*gi_256 = 32;	return 3;
+	case GUARD_INTERVAL_1_128:	*gi_256 = 2;	return 5;
+	case GUARD_INTERVAL_19_128:	*gi_256 = 38;	return 6;
+	case GUARD_INTERVAL_19_256:	*gi_256 = 19;	return 7;
+	default:			*gi_256 = 64;	return 4;
+	}
+}
+
+static u8 sit2_sim_cr_code(fe_code_rate_t cr)
+{
+	switch (cr) {
+	case FEC_1_2:	return 1;
+	case FEC_3_4:	return 3;
+	case FEC_4_5:	return 4;
+	case FEC_5_6:	return 5;
+	case FEC_7_8:	return 7;
+	case FEC_3_5:	return 13;
+	default:	return 2;
+	}
+}
+
+static u8 sit2_sim_system_code(fe_delivery_system_t s)
+{
+	switch (s) {
+	case SYS_DVBT2:		return 7;
+	case SYS_DVBC_ANNEX_A:	return 3;
+	default:		return 2;
+	}
+}
+
+/* time the demod needs from restart to lock on a mux */
+static u32 sit2_sim_lock_ms(const struct sit2_sim_mux *m)
+{
+	u32 fft, gi, bw_khz, sym_us, sr_ksym;
+
+	if (m->lock_ms)
+		return m->lock_ms;
+	if (m->delivery_system == SYS_DVBC_ANNEX_A) {
+		sr_ksym = max_t(u32, m->symbol_rate / 1000, 1000);
+		return 50 + 100 * 6900 / sr_ksym;
+	}
+	fft = sit2_sim_fft(m->transmission_mode);
+	sit2_sim_gi_code(m->guard_interval, &gi);
+	bw_khz = m->bandwidth_hz ? m->bandwidth_hz / 1000 : 8000;
+	sym_us = (u32)div_u64((u64)fft * 7 * (256 + gi) * 1000, 8 * bw_khz * 256);
+	if (m->delivery_system == SYS_DVBT2)
+		return 150 + 150 * sym_us / 1000;
+	return 50 + 150 * sym_us / 1000;
+}
+
+static u32 sit2_sim_ts_kbps(const struct sit2_sim_mux *m)
+{
+	if (m->ts_kbps)
+		return m->ts_kbps;
+	switch (m->delivery_system) {
+	case SYS_DVBC_ANNEX_A:
+		return (u32)div_u64((u64)m->symbol_rate * sit2_sim_qam_bits(m->modulation) * 188,
+				    204 * 1000);
+	case SYS_DVBT2:
+		return 36000;
+	default:
+		return 22000;
+	}
+}
+
+struct sit2_sim_mux *sit2_sim_find_mux(struct sit2_sim *sim, u32 frequency)
+{
+	int i;
+
+	for (i = 0; i < sim->num_mux; i++)
+		if (abs((s32)(sim->mux[i].frequency - frequency)) <= 250000)
+			return &sim->mux[i];
+	return NULL;
+}
+EXPORT_SYMBOL(sit2_sim_find_mux);
+
+int sit2_sim_add_mux(struct sit2_sim *sim, const struct sit2_sim_mux *mux)
+{
+	if (sim->num_mux >= SIT2_SIM_MUX_MAX)
+		return -ENOSPC;
+	sim->mux[sim->num_mux++] = *mux;
+	return 0;
+}
+EXPORT_SYMBOL(sit2_sim_add_mux);
+
+/* does the standard and parameter setup of the demod fit the mux */
+static bool sit2_sim_acq_match(struct sit2_sim *sim, const struct sit2_sim_mux *m)
+{
+	u16 dd_mode = sim->demod.props[0x100a];
+	u8 std = (dd_mode >> 4) & 0x0f, bw = dd_mode & 0x0f;
+	bool auto_detect = (dd_mode >> 9) & 1;
+	u32 sr = sim->demod.props[0x1102];
+	u8 qam = sim->demod.props[0x1101] & 0x0f;
+
+	if (m->delivery_system == SYS_DVBC_ANNEX_A) {
+		if (std != 3)
+			return false;
+		if (abs((s32)(sr - m->symbol_rate / 1000)) > m->symbol_rate / 500000)
+			return false;
+		return !qam || (qam == sit2_sim_qam_code(m->modulation));
+	}
+	if (bw != ((m->bandwidth_hz == 1700000) ? 2 : m->bandwidth_hz / 1000000))
+		return false;
+	if ((std == 15) || auto_detect)
+		return (std == 2) || (std == 7) || (std == 15);
+	return std == sit2_sim_system_code(m->delivery_system);
+}
+
+static void sit2_sim_restart(struct sit2_sim *sim, ktime_t now)
+{
+	struct sit2_sim_mux *m = sim->tuned ? sit2_sim_find_mux(sim, sim->tuner_freq) : NULL;
+	u32 lock_ms;
+
+	sim->stats.restarts++;
+	sim->acq = true;
+	sim->lost = false;
+	sim->acq_mux = (m && !m->off) ? m : NULL;
+	sim->lockable = sim->acq_mux && sit2_sim_acq_match(sim, m);
+	sim->dd_stat = 0;
+	sim->dd_int = 0;
+	sim->ber_windows = 0;
+	sim->ber_valid = false;
+	sim->ber_start = now;
+	sim->ucb_start = now;
+	if (sim->lockable) {
+		lock_ms = sit2_sim_lock_ms(m);
+		/* a T request that finds T2 tries T first */
+		if ((m->delivery_system == SYS_DVBT2) &&
+		    (((sim->demod.props[0x100a] >> 4) & 0x0f) != 7))
+			lock_ms += 150;
+		sim->pcl_at = ktime_add_ms(now, lock_ms / 3);
+		sim->lock_at = ktime_add_ms(now, lock_ms);
+		sim->nosig_at = KTIME_MAX;
+	} else if (sim->acq_mux) {
+		sim->pcl_at = ktime_add_ms(now, 50);
+		sim->lock_at = KTIME_MAX;
+		sim->nosig_at = ktime_add_ms(now, sim->timing.fail_ms);
+	} else {
+		sim->pcl_at = KTIME_MAX;
+		sim->lock_at = KTIME_MAX;
+		sim->nosig_at = ktime_add_ms(now, sim->timing.nosignal_ms);
+	}
+}
+
+/* measurement window of the BER counter, in us */
+static u64 sit2_sim_ber_window_us(struct sit2_sim *sim)
+{
+	u8 exp = sim->demod.props[0x1004] & 0x0f;
+	u64 bits = 1;
+
+	while (exp--)
+		bits *= 10;
+	return div_u64(bits * 1000, max_t(u32, sit2_sim_ts_kbps(sim->acq_mux), 1));
+}
+
+/* advance the acquisition to now and latch the interrupt flags */
+static void sit2_sim_acq_update(struct sit2_sim *sim, ktime_t now)
+{
+	struct sit2_sim_mux *m = sim->acq_mux;
+	u8 stat = 0;
+	u64 n;
+
+	if (!sim->acq)
+		return;
+	if (m && m->off) {
+		sim->lost = true;
+	} else if (m && sim->lost) {
+		/* the transmitter is back, the demod reacquires on its own */
+		sim->lost = false;
+		sim->pcl_at = ktime_add_ms(now, sit2_sim_lock_ms(m) / 3);
+		sim->lock_at = ktime_add_ms(now, sit2_sim_lock_ms(m));
+		sim->ber_start = sim->lock_at;
+		sim->ber_windows = 0;
+	}
+	if (!sim->lost) {
+		if (!ktime_before(now, sim->pcl_at))
+			stat |= SIT2_SIM_DD_PCL;
+		if (!ktime_before(now, sim->lock_at))
+			stat |= SIT2_SIM_DD_DL;
+		if (!ktime_before(now, sim->nosig_at))
+			stat |= SIT2_SIM_DD_NOSIG;
+	}
+	if (stat & SIT2_SIM_DD_DL) {
+		n = div64_u64(ktime_us_delta(now, sit2_sim_later(sim->lock_at, sim->ber_start)),
+			      max_t(u64, sit2_sim_ber_window_us(sim), 1));
+		if (n > sim->ber_windows) {
+			sim->ber_windows = n;
+			sim->ber_valid = true;
+			sim->dd_int |= SIT2_SIM_DD_BER;
+		}
+		if (sim->ber_valid)
+			stat |= SIT2_SIM_DD_BER;
+	}
+	sim->dd_int |= (stat ^ sim->dd_stat) & (SIT2_SIM_DD_PCL | SIT2_SIM_DD_DL);
+	sim->dd_int |= stat & ~sim->dd_stat & SIT2_SIM_DD_NOSIG;
+	sim->dd_stat = stat;
+}
+
+/* BER as mant/10 * 10^-exp, exp 0 while no window completed */
+static void sit2_sim_ber(struct sit2_sim *sim, u8 *exp, u8 *mant)
+{
+	u64 ber = sim->acq_mux ? sim->acq_mux->ber : 0;
+	u64 m;
+	u8 e;
+
+	*exp = 0;
+	*mant = 0;
+	if (!sim->ber_valid)
+		return;
+	if (!ber) {
+		*exp = sim->demod.props[0x1004] & 0x0f;
+		return;
+	}
+	for (e = 1, m = ber * 100; e < 15; e++, m *= 10)
+		if (m >= 10 * 1000000000ULL)
+			break;
+	*exp = e;
+	*mant = min_t(u64, div64_u64(m, 1000000000ULL), 99);
+}
+
+static void sit2_sim_reply(struct sit2_sim_chip *chip, ktime_t now, u32 us)
+{
+	chip->status &= ~SIT2_SIM_ERR;
+	chip->cts_at = ktime_add_us(now, us);
+}
+
+static void sit2_sim_error(struct sit2_sim *sim, struct sit2_sim_chip *chip, ktime_t now)
+{
+	memset(chip->reply, 0, sizeof(chip->reply));
+	chip->status |= SIT2_SIM_ERR;
+	chip->cts_at = ktime_add_us(now, sim->timing.cmd_us);
+	sim->stats.rejects++;
+}
+
+static void sit2_sim_set_prop(struct sit2_sim_chip *chip, const u8 *buf)
+{
+	u16 prop = buf[2] | (buf[3] << 8);
+	u16 old;
+
+	if (prop >= SIT2_SIM_PROPS)
+		return;
+	old = chip->props[prop];
+	chip->props[prop] = buf[4] | (buf[5] << 8);
+	chip->reply[2] = old & 0xff;
+	chip->reply[3] = old >> 8;
+}
+
+static void sit2_sim_demod_status(struct sit2_sim *sim, u8 *r, u8 cmd)
+{
+	struct sit2_sim_mux *m = sim->acq_mux;
+	u8 dl = sim->dd_stat & SIT2_SIM_DD_DL;
+	u32 gi;
+
+	r[2] = sim->dd_stat & (SIT2_SIM_DD_PCL | SIT2_SIM_DD_DL | SIT2_SIM_DD_BER);
+	if (!dl || !m)
+		return;
+	r[3] = m->cnr * 4 / 10;
+	r[8] = sit2_sim_qam_code(m->modulation);
+	switch (cmd) {
+	case 0xa0: /* DVBT_STATUS */
+		r[9] = sit2_sim_cr_code(m->code_rate);
+		r[10] = sit2_sim_fft_code(m->transmission_mode) |
+			(sit2_sim_gi_code(m->guard_interval, &gi) << 4);
+		r[11] = 1;
+		break;
+	case 0x50: /* DVBT2_STATUS */
+		r[9] = sit2_sim_fft_code(m->transmission_mode) |
+		       (sit2_sim_gi_code(m->guard_interval, &gi) << 4);
+		r[10] = max_t(u8, m->num_plp, 1);
+		r[11] = 7;
+		r[12] = sit2_sim_cr_code(m->code_rate);
+		r[13] = 2;
+		break;
+	}
+}
+
+static void sit2_sim_demod_cmd(struct sit2_sim *sim, const u8 *buf, u16 len, ktime_t now)
+{
+	struct sit2_sim_chip *d = &sim->demod;
+	u8 *r = d->reply;
+	u32 us = sim->timing.cmd_us;
+	u8 e, mn;
+	u64 ucb;
+
+	/* the pass-through is handled by the i2c front end, whatever runs */
+	if ((buf[0] == 0xc0) && (len == 3) && (buf[1] == 13)) {
+		sim->stats.demod_cmds[buf[0]]++;
+		sim->gate_open = buf[2] & 1;
+		return;
+	}
+	if (((d->mode == SIT2_SIM_BOOT) || (d->mode == SIT2_SIM_RUN)) &&
+	    ktime_before(now, d->cts_at))
+		sim->stats.violations++;
+	sim->stats.demod_cmds[buf[0]]++;
+	memset(r, 0, sizeof(d->reply));
+	sit2_sim_acq_update(sim, now);
+
+	if (buf[0] == 0xc0) {
+		if ((len == 13) && (buf[1] == 18)) {
+			/* START_CLK, no reply */
+			sim->clock_started = true;
+			return;
+		}
+		if ((len == 8) && (buf[1] == 6)) {
+			if (!sim->clock_started) {
+				sit2_sim_error(sim, d, now);
+				return;
+			}
+			/* POWER_UP: 1 resets to the ROM, 8 resumes a standby */
+			if ((buf[2] == 8) && (d->mode == SIT2_SIM_STANDBY)) {
+				d->mode = SIT2_SIM_RUN;
+			} else {
+				d->mode = SIT2_SIM_BOOT;
+				sim->patch_bytes = 0;
+				sim->patched = false;
+				memset(d->props, 0, sizeof(d->props));
+			}
+			sim->gate_open = false;
+			sim->acq = false;
+			sit2_sim_reply(d, now, sim->timing.power_up_us);
+			return;
+		}
+		sit2_sim_error(sim, d, now);
+		return;
+	}
+	if ((d->mode == SIT2_SIM_OFF) || (d->mode == SIT2_SIM_STANDBY)) {
+		/* asleep, nothing answers but the pass-through */
+		sim->stats.rejects++;
+		d->status &= ~SIT2_SIM_CTS;
+		d->cts_at = KTIME_MAX;
+		return;
+	}
+
+	switch (buf[0]) {
+	case 0x02: /* PART_INFO */
+		r[1] = 2;
+		r[2] = 68;
+		r[3] = '4';
+		r[4] = '0';
+		r[12] = sim->romid;
+		break;
+	case 0x01: /* START_FW */
+		if (d->mode != SIT2_SIM_BOOT) {
+			sit2_sim_error(sim, d, now);
+			return;
+		}
+		d->mode = SIT2_SIM_RUN;
+		sim->patched = sim->patch_bytes > 0;
+		us = sim->timing.start_fw_us;
+		break;
+	case 0x11: /* GET_REV */
+		r[1] = 68;
+		r[2] = 4;
+		r[3] = 0;
+		if (sim->patched && (d->mode == SIT2_SIM_RUN)) {
+			r[4] = sim->patch_rev & 0xff;
+			r[5] = sim->patch_rev >> 8;
+		}
+		r[6] = '4';
+		r[7] = '0';
+		r[8] = 11;
+		r[9] = 2;
+		break;
+	case 0x12: /* CONFIG_PINS */
+	case 0x88: /* DD_MP_DEFAULTS */
+	case 0x89: /* DD_EXT_AGC_TER */
+		memcpy(r + 1, buf + 1, min_t(u16, len, sizeof(d->reply)) - 1);
+		break;
+	case 0x13: /* POWER_DOWN, no reply */
+		d->mode = sim->lose_fw_on_sleep ? SIT2_SIM_OFF : SIT2_SIM_STANDBY;
+		sim->clock_started = false;
+		sim->acq = false;
+		sim->gate_open = false;
+		return;
+	case 0x14: /* SET_PROPERTY */
+		sit2_sim_set_prop(d, buf);
+		break;
+	case 0x82: /* DD_BER */
+		if (d->mode != SIT2_SIM_RUN)
+			goto bad;
+		sit2_sim_ber(sim, &e, &mn);
+		r[1] = e;
+		r[2] = mn;
+		if (buf[1] & 1) {
+			sim->ber_start = now;
+			sim->ber_windows = 0;
+			sim->ber_valid = false;
+			sim->dd_int &= ~SIT2_SIM_DD_BER;
+		}
+		break;
+	case 0x84: /* DD_UNCOR */
+		if (d->mode != SIT2_SIM_RUN)
+			goto bad;
+		ucb = 0;
+		if (sim->acq_mux && (sim->dd_stat & SIT2_SIM_DD_DL))
+			ucb = div_u64((u64)sim->acq_mux->ucb_per_s *
+				      ktime_us_delta(now, sit2_sim_later(sim->ucb_start, sim->lock_at)), 1000000);
+		ucb = min_t(u64, ucb, 0xffff);
+		r[1] = ucb & 0xff;
+		r[2] = ucb >> 8;
+		if (buf[1] & 1)
+			sim->ucb_start = now;
+		break;
+	case 0x85: /* DD_RESTART */
+		if (d->mode != SIT2_SIM_RUN)
+			goto bad;
+		sit2_sim_restart(sim, now);
+		us = sim->timing.restart_us;
+		break;
+	case 0x87: /* DD_STATUS */
+		if (d->mode != SIT2_SIM_RUN)
+			goto bad;
+		r[1] = sim->dd_int;
+		r[2] = sim->dd_stat;
+		r[3] = (sim->acq_mux && (sim->dd_stat & SIT2_SIM_DD_DL)) ?
+			sit2_sim_system_code(sim->acq_mux->delivery_system) :
+			(sim->demod.props[0x100a] >> 4) & 0x0f;
+		if (sim->acq_mux && (sim->dd_stat & SIT2_SIM_DD_DL)) {
+			r[4] = (sit2_sim_ts_kbps(sim->acq_mux) / 10) & 0xff;
+			r[5] = (sit2_sim_ts_kbps(sim->acq_mux) / 10) >> 8;
+		}
+		r[6] = d->props[0x100d] & 0xff;
+		r[7] = d->props[0x100d] >> 8;
+		if (buf[1] & 1)
+			sim->dd_int = 0;
+		break;
+	case 0x50: /* DVBT2_STATUS */
+	case 0x90: /* DVBC_STATUS */
+	case 0xa0: /* DVBT_STATUS */
+		if (d->mode != SIT2_SIM_RUN)
+			goto bad;
+		sit2_sim_demod_status(sim, r, buf[0]);
+		break;
+	case 0x51: /* DVBT2_FEF */
+		if (d->mode != SIT2_SIM_RUN)
+			goto bad;
+		break;
+	case 0x52: /* DVBT2_PLP_SELECT */
+		sim->plp_id = buf[1];
+		break;
+	case 0x53: /* DVBT2_PLP_INFO */
+		if (!sim->acq_mux || !(sim->dd_stat & SIT2_SIM_DD_DL) ||
+		    (buf[1] >= max_t(u8, sim->acq_mux->num_plp, 1)))
+			goto bad;
+		r[1] = buf[1];
+		r[2] = 3 | (1 << 5);
+		r[4] = sit2_sim_cr_code(sim->acq_mux->code_rate) |
+		       (sit2_sim_qam_code(sim->acq_mux->modulation) << 4);
+		r[5] = 1 << 1;
+		break;
+	case 0x54: /* DVBT2_TX_ID */
+		if (!sim->acq_mux || !(sim->dd_stat & SIT2_SIM_DD_DL))
+			goto bad;
+		r[1] = 1;
+		r[2] = (sim->acq_mux->frequency / 1000000) & 0xff;
+		r[4] = 0x01;
+		r[6] = 0x02;
+		break;
+	default:
+		if (d->mode != SIT2_SIM_BOOT)
+			goto bad;
+		/* anything else the ROM takes for a patch line */
+		sim->patch_bytes += len;
+		sim->stats.patch_lines++;
+		us = sim->timing.patch_line_us;
+		break;
+	}
+	sit2_sim_reply(d, now, us);
+	return;
+bad:
+	sit2_sim_error(sim, d, now);
+}
+
+static void sit2_sim_tuner_cmd(struct sit2_sim *sim, const u8 *buf, u16 len, ktime_t now)
+{
+	struct sit2_sim_chip *t = &sim->tuner;
+	struct sit2_sim_mux *m;
+	u8 *r = t->reply;
+	u32 us = sim->timing.cmd_us;
+
+	if ((t->mode != SIT2_SIM_OFF) && ktime_before(now, t->cts_at))
+		sim->stats.violations++;
+	sim->stats.tuner_cmds[buf[0]]++;
+	memset(r, 0, sizeof(t->reply));
+	/* a new command clears the tune interrupts */
+	t->status &= ~(SIT2_SIM_TUNINT | SIT2_SIM_DTVINT);
+	sim->tunint_at = KTIME_MAX;
+	sim->dtvint_at = KTIME_MAX;
+
+	if ((buf[0] == 0xc0) && (len == 15)) {
+		/* POWER_UP */
+		t->mode = SIT2_SIM_BOOT;
+		sim->tuned = false;
+		memset(t->props, 0, sizeof(t->props));
+		sit2_sim_reply(t, now, sim->timing.power_up_us);
+		return;
+	}
+	if (t->mode == SIT2_SIM_OFF) {
+		sit2_sim_error(sim, t, now);
+		return;
+	}
+	if (t->mode == SIT2_SIM_STANDBY)
+		t->mode = SIT2_SIM_RUN;
+
+	switch (buf[0]) {
+	case 0xc0: /* XOUT */
+		break;
+	case 0x01: /* START_FW */
+		t->mode = SIT2_SIM_RUN;
+		us = sim->timing.start_fw_us;
+		break;
+	case 0x12: /* CONFIG_PINS */
+		memcpy(r + 1, buf + 1, min_t(u16, len, sizeof(t->reply)) - 1);
+		break;
+	case 0x14: /* SET_PROPERTY */
+		sit2_sim_set_prop(t, buf);
+		break;
+	case 0x16: /* STANDBY */
+		t->mode = SIT2_SIM_STANDBY;
+		sim->tuned = false;
+		break;
+	case 0x41: /* TUNE */
+		if (t->mode != SIT2_SIM_RUN) {
+			sit2_sim_error(sim, t, now);
+			return;
+		}
+		sim->stats.tunes++;
+		sim->tuner_freq = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((u32)buf[7] << 24);
+		sim->tuned = true;
+		sim->tunint_at = ktime_add_us(now, sim->timing.tune_us);
+		sim->dtvint_at = ktime_add_us(sim->tunint_at, sim->timing.dtv_us);
+		break;
+	case 0x42: /* TUNER_STATUS */
+		m = sim->tuned ? sit2_sim_find_mux(sim, sim->tuner_freq) : NULL;
+		r[2] = sim->tuned ? 1 : 0;
+		r[3] = (m && !m->off) ? (u8)m->rssi : (u8)(s8)-100;
+		r[4] = sim->tuner_freq & 0xff;
+		r[5] = (sim->tuner_freq >> 8) & 0xff;
+		r[6] = (sim->tuner_freq >> 16) & 0xff;
+		r[7] = sim->tuner_freq >> 24;
+		r[8] = 1;
+		break;
+	default:
+		sit2_sim_error(sim, t, now);
+		return;
+	}
+	sit2_sim_reply(t, now, us);
+}
+
+static void sit2_sim_read(struct sit2_sim *sim, struct sit2_sim_chip *chip,
+			  u8 *buf, u16 len, ktime_t now, bool tuner)
+{
+	u8 status = chip->status & ~SIT2_SIM_CTS;
+
+	if (tuner) {
+		if (!ktime_before(now, sim->tunint_at))
+			status |= SIT2_SIM_TUNINT;
+		if (!ktime_before(now, sim->dtvint_at))
+			status |= SIT2_SIM_DTVINT;
+	}
+	memset(buf, 0, len);
+	if (ktime_before(now, chip->cts_at)) {
+		buf[0] = status;
+		return;
+	}
+	chip->status = status | SIT2_SIM_CTS;
+	buf[0] = chip->status;
+	if (len > 1)
+		memcpy(buf + 1, chip->reply + 1, min_t(u16, len, sizeof(chip->reply)) - 1);
+}
+
+static int sit2_sim_xfer_one(struct sit2_sim *sim, struct i2c_msg *msg)
+{
+	bool rd = (msg->flags & I2C_M_RD) != 0;
+	struct sit2_sim_chip *chip;
+	ktime_t now;
+
+	sim->stats.xfers++;
+	sim->stats.bytes += msg->len;
+	sit2_sim_bus_time(sim, msg->len);
+	if (sim->nak_xfers) {
+		sim->nak_xfers--;
+		sim->stats.naks++;
+		return -EREMOTEIO;
+	}
+	if (msg->addr == SIT2_SIM_DEMOD_ADDR)
+		chip = &sim->demod;
+	else if ((msg->addr == SIT2_SIM_TUNER_ADDR) && sim->gate_open)
+		chip = &sim->tuner;
+	else {
+		sim->stats.naks++;
+		return -EREMOTEIO;
+	}
+	if (!msg->len)
+		return 0;
+	now = sit2_sim_now(sim);
+	if (rd) {
+		sit2_sim_read(sim, chip, msg->buf, msg->len, now, chip == &sim->tuner);
+		return 0;
+	}
+	if (chip == &sim->tuner)
+		sit2_sim_tuner_cmd(sim, msg->buf, msg->len, now);
+	else
+		sit2_sim_demod_cmd(sim, msg->buf, msg->len, now);
+	if (sim->hang_cmds && ktime_after(chip->cts_at, now)) {
+		/* the chip never finishes this command */
+		sim->hang_cmds--;
+		chip->cts_at = KTIME_MAX;
+	}
+	return 0;
+}
+
+static int sit2_sim_master_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	struct sit2_sim *sim = i2c_get_adapdata(adap);
+	int i, ret;
+
+	for (i = 0; i < num; i++) {
+		ret = sit2_sim_xfer_one(sim, &msgs[i]);
+		if (ret)
+			return ret;
+	}
+	return num;
+}
+
+static u32 sit2_sim_functionality(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C;
+}
+
+static const struct i2c_algorithm sit2_sim_algo = {
+	.master_xfer	= sit2_sim_master_xfer,
+	.functionality	= sit2_sim_functionality,
+};
+
+void sit2_sim_power_cycle(struct sit2_sim *sim)
+{
+	memset(&sim->demod, 0, sizeof(sim->demod));
+	memset(&sim->tuner, 0, sizeof(sim->tuner));
+	/* both chips come out of reset ready for a command */
+	sim->demod.status = SIT2_SIM_CTS;
+	sim->tuner.status = SIT2_SIM_CTS;
+	sim->gate_open = false;
+	sim->clock_started = false;
+	sim->patch_bytes = 0;
+	sim->patched = false;
+	sim->tuned = false;
+	sim->tunint_at = KTIME_MAX;
+	sim->dtvint_at = KTIME_MAX;
+	sim->acq = false;
+	sim->acq_mux = NULL;
+}
+EXPORT_SYMBOL(sit2_sim_power_cycle);
+
+struct sit2_sim *sit2_sim_create(void)
+{
+	struct sit2_sim *sim;
+
+	sim = kzalloc(sizeof(*sim), GFP_KERNEL);
+	if (!sim)
+		return NULL;
+	sim->timing = sit2_sim_timing_default;
+	sim->timing.cmd_us = max(sit2_sim_cmd_us, 0);
+	sim->timing.tune_us = max(sit2_sim_tune_us, 0);
+	sim->timing.bus_khz = max(sit2_sim_bus_khz, 0);
+	sim->romid = 3;
+	sim->patch_rev = 0x0b70;	/* as the shipped Ver30 patch */
+	sit2_sim_power_cycle(sim);
+
+	sim->adap.owner = THIS_MODULE;
+	sim->adap.algo = &sit2_sim_algo;
+	strscpy(sim->adap.name, "sit2 simulator", sizeof(sim->adap.name));
+	i2c_set_adapdata(&sim->adap, sim);
+	if (i2c_add_adapter(&sim->adap)) {
+		kfree(sim);
+		return NULL;
+	}
+	return sim;
+}
+EXPORT_SYMBOL(sit2_sim_create);
+
+void sit2_sim_destroy(struct sit2_sim *sim)
+{
+	if (!sim)
+		return;
+	i2c_del_adapter(&sim->adap);
+	kfree(sim);
+}
+EXPORT_SYMBOL(sit2_sim_destroy);
+
+MODULE_DESCRIPTION("SIT2 Si2168/Si2158 protocol simulator");
+MODULE_LICENSE("GPL");
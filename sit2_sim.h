@@ -0,0 +1,147 @@
+/*
+    SIT2  - Si2168/Si2158 protocol simulator
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#ifndef SIT2_SIM_H
+#define SIT2_SIM_H
+
+#include <linux/i2c.h>
+#include <linux/ktime.h>
+#include "dvb_frontend.h"
+
+#define SIT2_SIM_MUX_MAX	16
+#define SIT2_SIM_PROPS		0x1400	/* property codes stay below this */
+
+/* one transmitted multiplex the tuner can find */
+struct sit2_sim_mux {
+	fe_delivery_system_t delivery_system;
+	u32 frequency;		/* Hz */
+	u32 bandwidth_hz;	/* DVB-T/T2 */
+	u32 symbol_rate;	/* DVB-C */
+	fe_modulation_t modulation;
+	fe_transmit_mode_t transmission_mode;
+	fe_guard_interval_t guard_interval;
+	fe_code_rate_t code_rate;
+	u8 num_plp;		/* DVB-T2 */
+	s8 rssi;		/* dBm at the tuner input */
+	u16 cnr;		/* 0.1 dB */
+	u32 ber;		/* bit errors per 10^9 bits */
+	u32 ucb_per_s;		/* uncorrectable packets per second */
+	u32 ts_kbps;		/* 0: derived from the parameters */
+	u32 lock_ms;		/* 0: derived from the parameters */
+	bool off;		/* transmitter switched off, the lock drops */
+};
+
+/* chip latencies, all configurable per instance */
+struct sit2_sim_timing {
+	u32 cmd_us;		/* ordinary command to CTS */
+	u32 power_up_us;
+	u32 start_fw_us;
+	u32 patch_line_us;
+	u32 restart_us;		/* DD_RESTART */
+	u32 tune_us;		/* tuner TUNE to tunint */
+	u32 dtv_us;		/* tunint to dtvint */
+	u32 nosignal_ms;	/* empty channel until the no-signal flag */
+	u32 fail_ms;		/* wrong parameters until the no-signal flag */
+	u32 bus_khz;		/* 0: transfers take no time */
+};
+
+/* what the simulated chips saw */
+struct sit2_sim_stats {
+	u64 xfers;
+	u64 bytes;
+	u64 bus_us;
+	u32 naks;		/* transfers refused, injected or gate closed */
+	u32 violations;		/* commands sent before CTS */
+	u32 rejects;		/* commands the chip state does not take */
+	u32 demod_cmds[256];
+	u32 tuner_cmds[256];
+	u32 patch_lines;
+	u32 restarts;
+	u32 tunes;
+};
+
+enum sit2_sim_mode {
+	SIT2_SIM_OFF = 0,	/* never powered, or powered down and lost */
+	SIT2_SIM_BOOT,		/* ROM running, takes patch lines */
+	SIT2_SIM_RUN,
+	SIT2_SIM_STANDBY,
+};
+
+struct sit2_sim_chip {
+	enum sit2_sim_mode mode;
+	u8 reply[16];
+	u8 status;		/* first reply byte without CTS */
+	ktime_t cts_at;
+	u16 props[SIT2_SIM_PROPS];
+};
+
+struct sit2_sim {
+	struct i2c_adapter adap;
+	struct sit2_sim_timing timing;
+	struct sit2_sim_stats stats;
+	struct sit2_sim_mux mux[SIT2_SIM_MUX_MAX];
+	int num_mux;
+
+	/* chip identity */
+	u8 romid;
+	u16 patch_rev;		/* reported by GET_REV once a patch runs */
+	bool lose_fw_on_sleep;
+
+	/* fault injection, each counts down */
+	u32 nak_xfers;
+	u32 hang_cmds;
+
+	/* time source, the monotonic clock unless a test installs its own */
+	ktime_t (*now)(void *priv);
+	void (*delay)(void *priv, u32 us);
+	void *clock_priv;
+
+	struct sit2_sim_chip demod;
+	struct sit2_sim_chip tuner;
+	bool gate_open;
+	bool clock_started;
+	u32 patch_bytes;
+	bool patched;
+
+	/* tuner */
+	u32 tuner_freq;
+	bool tuned;
+	ktime_t tunint_at;
+	ktime_t dtvint_at;
+
+	/* demod acquisition */
+	bool acq;
+	struct sit2_sim_mux *acq_mux;
+	bool lockable;
+	bool lost;
+	ktime_t pcl_at;
+	ktime_t lock_at;
+	ktime_t nosig_at;
+	u8 dd_stat;		/* pcl 0x02, dl 0x04, ber 0x08, no signal 0x20 */
+	u8 dd_int;
+	u32 ber_windows;
+	ktime_t ber_start;
+	bool ber_valid;
+	ktime_t ucb_start;
+	u8 plp_id;
+};
+
+struct sit2_sim *sit2_sim_create(void);
+void sit2_sim_destroy(struct sit2_sim *sim);
+int sit2_sim_add_mux(struct sit2_sim *sim, const struct sit2_sim_mux *mux);
+struct sit2_sim_mux *sit2_sim_find_mux(struct sit2_sim *sim, u32 frequency);
+/* forget all chip state, as after a power cycle of the board */
+void sit2_sim_power_cycle(struct sit2_sim *sim);
+
+#endif
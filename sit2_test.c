@@ -0,0 +1,1031 @@
+/*
+    SIT2  - KUnit tests against the protocol simulator
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+/*
+ * Included at the end of sit2.c, so the cases see the driver state. The
+ * frontend is attached to a sit2_sim adapter and both run on the driver's
+ * virtual clock, so a test takes no real time and every run sends the same
+ * bus traffic. Besides the outcome, each operation is held to a budget of
+ * bus transactions, bytes and simulated time.
+ */
+#include <kunit/test.h>
+#include "sit2_sim.h"
+
+static int sit2_test_slack = 10;
+module_param(sit2_test_slack, int, 0644);
+MODULE_PARM_DESC(sit2_test_slack, "Allowed excess over the operation budgets, in percent (default:10)");
+
+enum sit2_test_budget_id {
+	SIT2_TB_COLD_INIT = 0,
+	SIT2_TB_WARM_INIT,
+	SIT2_TB_SLEEP,
+	SIT2_TB_TUNE_T,
+	SIT2_TB_TUNE_T2,
+	SIT2_TB_TUNE_C,
+	SIT2_TB_TUNE_C_AUTO,
+	SIT2_TB_TUNE_EMPTY,
+	SIT2_TB_STATUS_T,
+	SIT2_TB_STATUS_T2,
+	SIT2_TB_STATUS_C,
+	SIT2_TB_FRONTEND_T,
+	SIT2_TB_FRONTEND_T2,
+	SIT2_TB_FRONTEND_C,
+	SIT2_TB_NUM
+};
+
+struct sit2_test_budget {
+	const char *name;
+	u32 xfers;
+	u32 bytes;
+	u32 ms;		/* simulated time holding the lock */
+};
+
+/* measured against the simulator defaults, sit2_test_slack on top */
+static const struct sit2_test_budget sit2_test_budgets[SIT2_TB_NUM] = {
+	[SIT2_TB_COLD_INIT]	= { "cold init",		4300, 14600, 1950 },
+	[SIT2_TB_WARM_INIT]	= { "warm init",		16, 70, 15 },
+	[SIT2_TB_SLEEP]		= { "sleep",			10, 16, 3 },
+	[SIT2_TB_TUNE_T]	= { "tune DVB-T",		60, 230, 320 },
+	[SIT2_TB_TUNE_T2]	= { "tune DVB-T2",		220, 1200, 930 },
+	[SIT2_TB_TUNE_C]	= { "tune DVB-C",		80, 350, 230 },
+	[SIT2_TB_TUNE_C_AUTO]	= { "tune DVB-C, no rate",	890, 5000, 3420 },
+	[SIT2_TB_TUNE_EMPTY]	= { "tune empty channel",	60, 230, 340 },
+	[SIT2_TB_STATUS_T]	= { "read_status DVB-T",	3, 18, 2 },
+	[SIT2_TB_STATUS_T2]	= { "read_status DVB-T2",	3, 18, 2 },
+	[SIT2_TB_STATUS_C]	= { "read_status DVB-C",	3, 18, 2 },
+	[SIT2_TB_FRONTEND_T]	= { "get_frontend DVB-T",	0, 0, 0 },
+	[SIT2_TB_FRONTEND_T2]	= { "get_frontend DVB-T2",	0, 0, 0 },
+	[SIT2_TB_FRONTEND_C]	= { "get_frontend DVB-C",	0, 0, 0 },
+};
+
+static const struct sit2_sim_mux sit2_test_mux_t = {
+	.delivery_system = SYS_DVBT, .frequency = 474000000,
+	.bandwidth_hz = 8000000, .modulation = QAM_64,
+	.transmission_mode = TRANSMISSION_MODE_8K,
+	.guard_interval = GUARD_INTERVAL_1_4, .code_rate = FEC_2_3,
+	.rssi = -55, .cnr = 280, .ber = 2000,
+};
+
+static const struct sit2_sim_mux sit2_test_mux_t2 = {
+	.delivery_system = SYS_DVBT2, .frequency = 522000000,
+	.bandwidth_hz = 8000000, .modulation = QAM_256,
+	.transmission_mode = TRANSMISSION_MODE_32K,
+	.guard_interval = GUARD_INTERVAL_1_128, .code_rate = FEC_3_5,
+	.num_plp = 2, .rssi = -60, .cnr = 250, .ber = 500,
+};
+
+static const struct sit2_sim_mux sit2_test_mux_c = {
+	.delivery_system = SYS_DVBC_ANNEX_A, .frequency = 346000000,
+	.symbol_rate = 6900000, .modulation = QAM_256,
+	.rssi = -48, .cnr = 360, .ber = 100,
+};
+
+/* not in the default candidates at the top, found by the search */
+static const struct sit2_sim_mux sit2_test_mux_c_auto = {
+	.delivery_system = SYS_DVBC_ANNEX_A, .frequency = 354000000,
+	.symbol_rate = 6875000, .modulation = QAM_64,
+	.rssi = -50, .cnr = 330, .ber = 100,
+};
+
+/* a constellation none of the candidates uses */
+static const struct sit2_sim_mux sit2_test_mux_c_qam128 = {
+	.delivery_system = SYS_DVBC_ANNEX_A, .frequency = 362000000,
+	.symbol_rate = 6952000, .modulation = QAM_128,
+	.rssi = -50, .cnr = 330, .ber = 100,
+};
+
+struct sit2_test_ctx {
+	struct sit2_sim *sim;
+	struct dvb_frontend *fe;
+	struct sit2_state *state;
+	struct sit2_config config;
+};
+
+static ktime_t sit2_test_now(void *priv)
+{
+	return sit2_now(priv);
+}
+
+static void sit2_test_delay(void *priv, u32 us)
+{
+	struct sit2_state *state = priv;
+
+	state->vclock_us += us;
+}
+
+static int sit2_test_init(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->sim = sit2_sim_create();
+	if (!ctx->sim) {
+		kfree(ctx);
+		return -ENOMEM;
+	}
+	sit2_sim_add_mux(ctx->sim, &sit2_test_mux_t);
+	sit2_sim_add_mux(ctx->sim, &sit2_test_mux_t2);
+	sit2_sim_add_mux(ctx->sim, &sit2_test_mux_c);
+	sit2_sim_add_mux(ctx->sim, &sit2_test_mux_c_auto);
+	sit2_sim_add_mux(ctx->sim, &sit2_test_mux_c_qam128);
+	ctx->config.ts_bus_mode = 2;
+	ctx->fe = sit2_attach(&ctx->config, &ctx->sim->adap);
+	if (!ctx->fe) {
+		sit2_sim_destroy(ctx->sim);
+		kfree(ctx);
+		return -ENODEV;
+	}
+	ctx->state = ctx->fe->demodulator_priv;
+	/* the chips and the driver share the virtual clock */
+	ctx->state->vclock = true;
+	ctx->sim->now = sit2_test_now;
+	ctx->sim->delay = sit2_test_delay;
+	ctx->sim->clock_priv = ctx->state;
+	test->priv = ctx;
+	return 0;
+}
+
+static void sit2_test_exit(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+
+	ctx->fe->ops.release(ctx->fe);
+	sit2_sim_destroy(ctx->sim);
+	kfree(ctx);
+}
+
+/* hold the cost of one operation since before against its budget */
+static void sit2_test_budget(struct kunit *test, enum sit2_test_budget_id id,
+			     enum sit2_op op, const struct sit2_op_stats *before)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	const struct sit2_test_budget *b = &sit2_test_budgets[id];
+	const struct sit2_op_stats *st = &ctx->state->op_stats[op];
+	u32 pct = 100 + max(sit2_test_slack, 0);
+	u64 xfers = st->xfers - before->xfers;
+	u64 bytes = st->bytes - before->bytes;
+	u64 ms = div_u64(st->time_us - before->time_us, 1000);
+
+	kunit_info(test, "%s: %llu xfers, %llu bytes, %llu ms\n", b->name,
+		   xfers, bytes, ms);
+	KUNIT_EXPECT_LE_MSG(test, xfers, div_u64((u64)b->xfers * pct, 100),
+			    "%s transactions", b->name);
+	KUNIT_EXPECT_LE_MSG(test, bytes, div_u64((u64)b->bytes * pct, 100),
+			    "%s bytes", b->name);
+	KUNIT_EXPECT_LE_MSG(test, ms, div_u64((u64)b->ms * pct, 100),
+			    "%s time", b->name);
+}
+
+/* the property cache as dvb-core fills it for a tune request */
+static void sit2_test_props(struct dvb_frontend *fe, const struct sit2_sim_mux *m)
+{
+	struct dtv_frontend_properties *c = &fe->dtv_property_cache;
+
+	memset(c, 0, sizeof(*c));
+	c->delivery_system = m->delivery_system;
+	c->frequency = m->frequency;
+	c->inversion = INVERSION_AUTO;
+	c->stream_id = NO_STREAM_ID_FILTER;
+	if (m->delivery_system == SYS_DVBC_ANNEX_A) {
+		c->symbol_rate = m->symbol_rate;
+		c->modulation = m->modulation;
+		c->fec_inner = FEC_AUTO;
+		return;
+	}
+	c->bandwidth_hz = m->bandwidth_hz;
+	c->modulation = QAM_AUTO;
+	c->transmission_mode = TRANSMISSION_MODE_AUTO;
+	c->guard_interval = GUARD_INTERVAL_AUTO;
+	c->hierarchy = HIERARCHY_AUTO;
+	c->code_rate_HP = FEC_AUTO;
+	c->code_rate_LP = FEC_AUTO;
+}
+
+static fe_status_t sit2_test_tune(struct kunit *test, const struct sit2_sim_mux *m)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	unsigned int delay;
+	fe_status_t status = 0;
+
+	sit2_test_props(ctx->fe, m);
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.tune(ctx->fe, true, 0, &delay, &status), 0);
+	/* the statistics worker must not run into the measurements */
+	cancel_delayed_work_sync(&ctx->state->stats_work);
+	return status;
+}
+
+static void sit2_test_cold_init(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_op_stats before = ctx->state->op_stats[SIT2_OP_INIT];
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	sit2_test_budget(test, SIT2_TB_COLD_INIT, SIT2_OP_INIT, &before);
+	KUNIT_EXPECT_TRUE(test, ctx->state->isInited);
+	KUNIT_EXPECT_TRUE(test, ctx->state->fw_valid);
+	KUNIT_EXPECT_EQ(test, ctx->state->fw_rev.patch, ctx->sim->patch_rev);
+	KUNIT_EXPECT_TRUE(test, ctx->sim->patched);
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.violations, 0);
+	KUNIT_EXPECT_EQ(test, ctx->state->cmd_fails, 0);
+	/* the tuner is closed off again once init is done */
+	KUNIT_EXPECT_FALSE(test, ctx->sim->gate_open);
+}
+
+static void sit2_test_tune_one(struct kunit *test, const struct sit2_sim_mux *m,
+			       enum sit2_test_budget_id tune_id,
+			       enum sit2_test_budget_id status_id,
+			       enum sit2_test_budget_id frontend_id)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct dtv_frontend_properties *c = &ctx->fe->dtv_property_cache;
+	enum sit2_op op = sit2_tune_op(m->delivery_system);
+	struct sit2_op_stats before;
+	fe_status_t status;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	before = ctx->state->op_stats[op];
+	status = sit2_test_tune(test, m);
+	sit2_test_budget(test, tune_id, op, &before);
+	KUNIT_ASSERT_TRUE(test, status & FE_HAS_LOCK);
+
+	before = ctx->state->op_stats[SIT2_OP_STATUS];
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.read_status(ctx->fe, &status), 0);
+	sit2_test_budget(test, status_id, SIT2_OP_STATUS, &before);
+	KUNIT_EXPECT_TRUE(test, status & FE_HAS_LOCK);
+
+	before = ctx->state->op_stats[SIT2_OP_GET_FRONTEND];
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.get_frontend(ctx->fe), 0);
+	sit2_test_budget(test, frontend_id, SIT2_OP_GET_FRONTEND, &before);
+	KUNIT_EXPECT_EQ(test, c->delivery_system, m->delivery_system);
+	KUNIT_EXPECT_EQ(test, c->modulation, m->modulation);
+	if (m->delivery_system == SYS_DVBC_ANNEX_A) {
+		KUNIT_EXPECT_EQ(test, c->symbol_rate, m->symbol_rate);
+	} else {
+		KUNIT_EXPECT_EQ(test, c->transmission_mode, m->transmission_mode);
+		KUNIT_EXPECT_EQ(test, c->guard_interval, m->guard_interval);
+	}
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.violations, 0);
+	KUNIT_EXPECT_EQ(test, ctx->state->cmd_fails, 0);
+}
+
+static void sit2_test_tune_dvbt(struct kunit *test)
+{
+	sit2_test_tune_one(test, &sit2_test_mux_t, SIT2_TB_TUNE_T,
+			   SIT2_TB_STATUS_T, SIT2_TB_FRONTEND_T);
+}
+
+static void sit2_test_tune_dvbt2(struct kunit *test)
+{
+	sit2_test_tune_one(test, &sit2_test_mux_t2, SIT2_TB_TUNE_T2,
+			   SIT2_TB_STATUS_T2, SIT2_TB_FRONTEND_T2);
+}
+
+static void sit2_test_tune_dvbc(struct kunit *test)
+{
+	sit2_test_tune_one(test, &sit2_test_mux_c, SIT2_TB_TUNE_C,
+			   SIT2_TB_STATUS_C, SIT2_TB_FRONTEND_C);
+}
+
+static void sit2_test_dvbc_auto(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_sim_mux m = sit2_test_mux_c_auto;
+	struct sit2_op_stats before;
+	fe_status_t status;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	m.symbol_rate = 0;
+	m.modulation = QAM_AUTO;
+	before = ctx->state->op_stats[SIT2_OP_TUNE_C];
+	status = sit2_test_tune(test, &m);
+	sit2_test_budget(test, SIT2_TB_TUNE_C_AUTO, SIT2_OP_TUNE_C, &before);
+	KUNIT_ASSERT_TRUE(test, status & FE_HAS_LOCK);
+	KUNIT_EXPECT_EQ(test, ctx->state->dvbc_auto_locks, 1);
+	/* the rate that locked is tried first next time */
+	KUNIT_EXPECT_EQ(test, ctx->state->dvbc_cand[0].symbol_rate,
+			sit2_test_mux_c_auto.symbol_rate);
+	KUNIT_EXPECT_EQ(test, ctx->state->dvbc_cand[0].modulation,
+			sit2_test_mux_c_auto.modulation);
+}
+
+static void sit2_test_dvbc_auto_rate(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_sim_mux m = sit2_test_mux_c_qam128;
+	fe_status_t status;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	/* QAM256 given: only its candidates are tried, no search after them */
+	m.symbol_rate = 0;
+	m.modulation = QAM_256;
+	KUNIT_EXPECT_FALSE(test, sit2_test_tune(test, &m) & FE_HAS_LOCK);
+	KUNIT_EXPECT_EQ(test, ctx->state->dvbc_auto_tries, 4);
+	/* QAM128 is in no candidate, the common rates are searched with it */
+	m.modulation = QAM_128;
+	status = sit2_test_tune(test, &m);
+	KUNIT_ASSERT_TRUE(test, status & FE_HAS_LOCK);
+	KUNIT_EXPECT_EQ(test, ctx->state->dvbc_cand[0].symbol_rate,
+			sit2_test_mux_c_qam128.symbol_rate);
+	KUNIT_EXPECT_EQ(test, ctx->state->dvbc_cand[0].modulation, QAM_128);
+}
+
+static void sit2_test_no_signal(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_sim_mux m = sit2_test_mux_t;
+	struct sit2_op_stats before;
+	fe_status_t status;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	m.frequency = 650000000;
+	before = ctx->state->op_stats[SIT2_OP_TUNE_T];
+	status = sit2_test_tune(test, &m);
+	sit2_test_budget(test, SIT2_TB_TUNE_EMPTY, SIT2_OP_TUNE_T, &before);
+	KUNIT_EXPECT_FALSE(test, status & FE_HAS_LOCK);
+	KUNIT_EXPECT_EQ(test, ctx->state->cmd_fails, 0);
+}
+
+static void sit2_test_lock_model(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct dtv_frontend_properties c = {};
+	u32 min_ms, max_ms, static_ms;
+	u8 bucket;
+	int i;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	/* filed under the detected 8K and under the AUTO slot of the request */
+	KUNIT_EXPECT_EQ(test, ctx->state->lock_stat[TRANSMISSION_MODE_8K].samples, 1);
+	KUNIT_EXPECT_EQ(test, ctx->state->lock_stat[TRANSMISSION_MODE_AUTO].samples, 1);
+	KUNIT_EXPECT_EQ(test, ctx->state->lock_stat[SIT2_LOCK_MODES +
+						    TRANSMISSION_MODE_AUTO].samples, 0);
+
+	/* T2 of unknown mode on a new frequency: slowest mode, own AUTO slot */
+	c.delivery_system = SYS_DVBT2;
+	c.frequency = 700000000;
+	c.bandwidth_hz = 8000000;
+	c.transmission_mode = TRANSMISSION_MODE_AUTO;
+	c.guard_interval = GUARD_INTERVAL_AUTO;
+	bucket = sit2_lock_window(ctx->state, &c, &min_ms, &static_ms);
+	KUNIT_EXPECT_EQ(test, bucket, SIT2_LOCK_MODES + TRANSMISSION_MODE_AUTO);
+
+	/* fast locks move the first poll, never the worst case */
+	for (i = 0; i < SIT2_LOCK_LEARN_MIN; i++)
+		sit2_lock_learn_time(ctx->state, bucket, 100);
+	sit2_lock_window(ctx->state, &c, &min_ms, &max_ms);
+	KUNIT_EXPECT_LE(test, min_ms, 100);
+	KUNIT_EXPECT_EQ(test, max_ms, static_ms);
+
+	/* a timeout widens the window */
+	sit2_lock_learn_timeout(ctx->state, bucket);
+	sit2_lock_window(ctx->state, &c, &min_ms, &max_ms);
+	KUNIT_EXPECT_EQ(test, max_ms, min_t(u32, static_ms * 3 / 2, 10000));
+}
+
+static void sit2_test_warm_resume(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_op_stats before;
+	u32 patch_lines;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	patch_lines = ctx->sim->stats.patch_lines;
+
+	before = ctx->state->op_stats[SIT2_OP_SLEEP];
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.sleep(ctx->fe), 0);
+	/* let the autosuspend expire now */
+	flush_delayed_work(&ctx->state->suspend_work);
+	sit2_test_budget(test, SIT2_TB_SLEEP, SIT2_OP_SLEEP, &before);
+	KUNIT_EXPECT_FALSE(test, ctx->state->powered);
+	KUNIT_EXPECT_EQ(test, ctx->sim->demod.mode, SIT2_SIM_STANDBY);
+
+	before = ctx->state->op_stats[SIT2_OP_INIT];
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	sit2_test_budget(test, SIT2_TB_WARM_INIT, SIT2_OP_INIT, &before);
+	/* the patch survived standby and is not sent again */
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.patch_lines, patch_lines);
+	KUNIT_EXPECT_EQ(test, ctx->state->fw_reloads, 0);
+	KUNIT_EXPECT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t2) & FE_HAS_LOCK);
+}
+
+static void sit2_test_resume_lost_fw(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	u32 patch_lines;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	patch_lines = ctx->sim->stats.patch_lines;
+	ctx->sim->lose_fw_on_sleep = true;
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.sleep(ctx->fe), 0);
+	flush_delayed_work(&ctx->state->suspend_work);
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	/* verification catches the lost patch and loads it again */
+	KUNIT_EXPECT_EQ(test, ctx->state->fw_reloads, 1);
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.patch_lines, 2 * patch_lines);
+	KUNIT_EXPECT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_c) & FE_HAS_LOCK);
+}
+
+/* a new driver instance finds the patch still loaded by the last one */
+static void sit2_test_adopt_standby(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	u32 patch_lines;
+	u64 vclock_us;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+		patch_lines = ctx->sim->stats.patch_lines;
+		/* release puts the idle chip in standby */
+		KUNIT_EXPECT_EQ(test, ctx->fe->ops.sleep(ctx->fe), 0);
+		vclock_us = ctx->state->vclock_us;
+		ctx->fe->ops.release(ctx->fe);
+		KUNIT_EXPECT_EQ(test, ctx->sim->demod.mode, SIT2_SIM_STANDBY);
+		/* the second time round it runs some other patch */
+		if (i)
+			ctx->sim->patch_rev++;
+		ctx->fe = sit2_attach(&ctx->config, &ctx->sim->adap);
+		KUNIT_ASSERT_NOT_NULL(test, ctx->fe);
+		ctx->state = ctx->fe->demodulator_priv;
+		/* the chips keep their time */
+		ctx->state->vclock = true;
+		ctx->state->vclock_us = vclock_us;
+		ctx->sim->clock_priv = ctx->state;
+		KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+		if (!i) {
+			KUNIT_EXPECT_EQ(test, ctx->state->fw_adopts, 1);
+			KUNIT_EXPECT_EQ(test, ctx->sim->stats.patch_lines, patch_lines);
+		} else {
+			KUNIT_EXPECT_EQ(test, ctx->state->fw_adopts, 0);
+			KUNIT_EXPECT_GT(test, ctx->sim->stats.patch_lines, patch_lines);
+		}
+		KUNIT_EXPECT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	}
+}
+
+static void sit2_test_system_sleep(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	unsigned int delay;
+	fe_status_t status;
+	u64 xfers;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	sit2_pm_notify(&state->pm_nb, PM_SUSPEND_PREPARE, NULL);
+	KUNIT_EXPECT_FALSE(test, state->powered);
+	KUNIT_EXPECT_EQ(test, ctx->sim->demod.mode, SIT2_SIM_STANDBY);
+
+	/* resume itself does not touch the chip */
+	xfers = ctx->sim->stats.xfers;
+	sit2_pm_notify(&state->pm_nb, PM_POST_SUSPEND, NULL);
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.xfers, xfers);
+	KUNIT_EXPECT_TRUE(test, state->retune_pending);
+
+	/* the frontend thread's next poll powers up and retunes */
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.tune(ctx->fe, false, 0, &delay, &status), 0);
+	cancel_delayed_work_sync(&state->stats_work);
+	KUNIT_EXPECT_TRUE(test, status & FE_HAS_LOCK);
+	KUNIT_EXPECT_TRUE(test, state->powered);
+	KUNIT_EXPECT_EQ(test, state->pm_retunes, 1);
+
+	/* an open but idle frontend is powered down too */
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.sleep(ctx->fe), 0);
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, state->powered);
+	sit2_pm_notify(&state->pm_nb, PM_SUSPEND_PREPARE, NULL);
+	KUNIT_EXPECT_FALSE(test, state->powered);
+	sit2_pm_notify(&state->pm_nb, PM_POST_SUSPEND, NULL);
+	KUNIT_EXPECT_FALSE(test, state->retune_pending);
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.violations, 0);
+}
+
+/* one run of the statistics worker, ms after the last */
+static void sit2_test_poll(struct kunit *test, u32 ms)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+
+	ctx->state->vclock_us += (u64)ms * 1000;
+	mod_delayed_work(system_wq, &ctx->state->stats_work, 0);
+	flush_delayed_work(&ctx->state->stats_work);
+	cancel_delayed_work_sync(&ctx->state->stats_work);
+}
+
+/* a lost lock goes through grace, demod restart and retune in that order */
+static void sit2_test_watchdog(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	struct sit2_sim_mux *m;
+	unsigned int delay;
+	fe_status_t status;
+	u32 restarts;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	sit2_test_poll(test, 0);
+	KUNIT_ASSERT_TRUE(test, state->wd_locked);
+	m = sit2_sim_find_mux(ctx->sim, sit2_test_mux_t.frequency);
+	KUNIT_ASSERT_NOT_NULL(test, m);
+	m->off = true;
+
+	sit2_test_poll(test, SIT2_WD_POLL_MS);
+	KUNIT_EXPECT_EQ(test, state->wd_stage, SIT2_WD_GRACE);
+	KUNIT_EXPECT_EQ(test, state->wd_dropouts, 1);
+	KUNIT_EXPECT_EQ(test, state->wd_restarts, 0);
+
+	restarts = ctx->sim->stats.restarts;
+	sit2_test_poll(test, sit2_wd_grace_ms);
+	KUNIT_EXPECT_EQ(test, state->wd_stage, SIT2_WD_RESTART);
+	KUNIT_EXPECT_EQ(test, state->wd_restarts, 1);
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.restarts, restarts + 1);
+	KUNIT_EXPECT_EQ(test, state->wd_retunes, 0);
+	KUNIT_EXPECT_FALSE(test, state->retune_pending);
+
+	sit2_test_poll(test, sit2_wd_restart_ms);
+	KUNIT_EXPECT_EQ(test, state->wd_stage, SIT2_WD_RETUNE);
+	KUNIT_EXPECT_EQ(test, state->wd_retunes, 1);
+	KUNIT_EXPECT_TRUE(test, state->retune_pending);
+	/* the retune is the frontend thread's, the worker asks again if it fails */
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.tune(ctx->fe, false, 0, &delay, &status), 0);
+	cancel_delayed_work_sync(&state->stats_work);
+	KUNIT_EXPECT_FALSE(test, status & FE_HAS_LOCK);
+	sit2_test_poll(test, SIT2_WD_POLL_MS);
+	KUNIT_EXPECT_EQ(test, state->wd_stage, SIT2_WD_RETUNE);
+	KUNIT_EXPECT_FALSE(test, state->retune_pending);
+	sit2_test_poll(test, sit2_wd_restart_ms);
+	KUNIT_EXPECT_EQ(test, state->wd_restarts, 1);
+	KUNIT_EXPECT_EQ(test, state->wd_retunes, 2);
+	KUNIT_EXPECT_TRUE(test, state->retune_pending);
+
+	m->off = false;
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.tune(ctx->fe, false, 0, &delay, &status), 0);
+	KUNIT_EXPECT_TRUE(test, status & FE_HAS_LOCK);
+	sit2_test_poll(test, 0);
+	KUNIT_EXPECT_EQ(test, state->wd_stage, SIT2_WD_IDLE);
+	KUNIT_EXPECT_EQ(test, state->wd_retune_relocks, 1);
+	KUNIT_EXPECT_EQ(test, state->wd_restart_relocks, 0);
+	KUNIT_EXPECT_GE(test, state->wd_recover_ms_last,
+			(u32)(sit2_wd_grace_ms + 2 * sit2_wd_restart_ms));
+	KUNIT_EXPECT_EQ(test, state->wd_retunes, 2);
+	KUNIT_EXPECT_EQ(test, state->wd_dropouts, 1);
+}
+
+/* the transmitter is back in time, the demod restart is enough */
+static void sit2_test_watchdog_restart(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	struct sit2_sim_mux *m;
+	int i;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_c) & FE_HAS_LOCK);
+	sit2_test_poll(test, 0);
+	m = sit2_sim_find_mux(ctx->sim, sit2_test_mux_c.frequency);
+	KUNIT_ASSERT_NOT_NULL(test, m);
+	m->off = true;
+	sit2_test_poll(test, SIT2_WD_POLL_MS);
+	m->off = false;
+	sit2_test_poll(test, sit2_wd_grace_ms);
+	KUNIT_EXPECT_EQ(test, state->wd_stage, SIT2_WD_RESTART);
+	for (i = 0; (i < 50) && (state->wd_stage != SIT2_WD_IDLE); i++)
+		sit2_test_poll(test, SIT2_WD_POLL_MS);
+	KUNIT_EXPECT_EQ(test, state->wd_stage, SIT2_WD_IDLE);
+	KUNIT_EXPECT_EQ(test, state->wd_restarts, 1);
+	KUNIT_EXPECT_EQ(test, state->wd_restart_relocks, 1);
+	KUNIT_EXPECT_EQ(test, state->wd_retunes, 0);
+	KUNIT_EXPECT_FALSE(test, state->retune_pending);
+}
+
+/* with the chip failing as well, recovery climbs to a cold init before the retune */
+static void sit2_test_watchdog_cold_init(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	struct sit2_sim_mux *m;
+	unsigned int delay;
+	fe_status_t status;
+	u32 patch_lines;
+	int i;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t2) & FE_HAS_LOCK);
+	patch_lines = ctx->sim->stats.patch_lines;
+	sit2_test_poll(test, 0);
+	m = sit2_sim_find_mux(ctx->sim, sit2_test_mux_t2.frequency);
+	KUNIT_ASSERT_NOT_NULL(test, m);
+	m->off = true;
+	sit2_test_poll(test, SIT2_WD_POLL_MS);
+	sit2_test_poll(test, sit2_wd_grace_ms);
+	sit2_test_poll(test, sit2_wd_restart_ms);
+	KUNIT_ASSERT_EQ(test, state->wd_stage, SIT2_WD_RETUNE);
+	KUNIT_ASSERT_EQ(test, state->wd_restarts, 1);
+	m->off = false;
+
+	/* each status poll of the frontend thread hangs, one level per poll */
+	for (i = SIT2_RECOVER_DEMOD_RESTART; i <= SIT2_RECOVER_COLD_INIT; i++) {
+		ctx->sim->hang_cmds = max(sit2_retry_max, 0) + 1;
+		state->vclock_us += (u64)max(sit2_recover_ms, 0) * 1000;
+		ctx->fe->ops.read_status(ctx->fe, &status);
+		KUNIT_EXPECT_EQ(test, state->recover_level, i);
+	}
+	KUNIT_EXPECT_EQ(test, state->rec_restarts, 1);
+	KUNIT_EXPECT_EQ(test, state->rec_tuner_inits, 1);
+	KUNIT_EXPECT_EQ(test, state->rec_warm_inits, 1);
+	KUNIT_EXPECT_EQ(test, state->rec_cold_inits, 1);
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.patch_lines, 2 * patch_lines);
+
+	/* the retune after the cold init ends the dropout */
+	KUNIT_EXPECT_TRUE(test, state->retune_pending);
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.tune(ctx->fe, false, 0, &delay, &status), 0);
+	KUNIT_EXPECT_TRUE(test, status & FE_HAS_LOCK);
+	sit2_test_poll(test, 0);
+	KUNIT_EXPECT_EQ(test, state->wd_stage, SIT2_WD_IDLE);
+	KUNIT_EXPECT_EQ(test, state->wd_retune_relocks, 1);
+	KUNIT_EXPECT_EQ(test, state->wd_dropouts, 1);
+}
+
+/* the chip's 16-bit UCB count is read and reset per poll, the totals go on */
+static void sit2_test_stats_counters(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	struct dtv_frontend_properties *c = &ctx->fe->dtv_property_cache;
+	struct sit2_sim_mux *m;
+	u64 ucb, bits;
+	u32 ucblocks;
+	int i;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	m = sit2_sim_find_mux(ctx->sim, sit2_test_mux_t.frequency);
+	KUNIT_ASSERT_NOT_NULL(test, m);
+	m->ucb_per_s = 40000;
+	sit2_test_poll(test, 0);
+	ucb = state->ucb_total;
+	for (i = 0; i < 5; i++)
+		sit2_test_poll(test, 1000);
+	/* nothing lost to the wrap, the polls themselves take a few ms */
+	ucb = state->ucb_total - ucb;
+	KUNIT_EXPECT_GE(test, ucb, 5 * 40000ULL);
+	KUNIT_EXPECT_LE(test, ucb, 5 * 40000ULL + 4000);
+	KUNIT_EXPECT_EQ(test, c->block_error.stat[0].scale, FE_SCALE_COUNTER);
+	KUNIT_EXPECT_EQ(test, c->block_error.stat[0].uvalue, state->ucb_total);
+	KUNIT_EXPECT_EQ(test, ctx->fe->ops.read_ucblocks(ctx->fe, &ucblocks), 0);
+	KUNIT_EXPECT_EQ(test, (u64)ucblocks, state->ucb_total);
+
+	/* one finished window per poll, counted in full */
+	KUNIT_EXPECT_GE(test, state->ber_windows, 5);
+	bits = sit2_pow10(clamp(sit2_ber_window, 1, 9));
+	KUNIT_EXPECT_EQ(test, state->ber_bits, state->ber_windows * bits);
+	KUNIT_EXPECT_EQ(test, state->ber_errors, (u64)state->ber_windows * state->ber_last);
+	KUNIT_EXPECT_EQ(test, c->post_bit_count.stat[0].uvalue, state->ber_bits);
+	KUNIT_EXPECT_EQ(test, c->post_bit_error.stat[0].uvalue, state->ber_errors);
+}
+
+/* 64-QAM 2/3 needs 18.7 dB, 256-QAM 3/5 on T2 19.4 dB, the score saturates 10 dB over */
+static void sit2_test_quality(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	struct dtv_frontend_properties *c = &ctx->fe->dtv_property_cache;
+	struct sit2_sim_mux *m;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	m = sit2_sim_find_mux(ctx->sim, sit2_test_mux_t.frequency);
+	KUNIT_ASSERT_NOT_NULL(test, m);
+	sit2_test_poll(test, 1000);
+	KUNIT_ASSERT_TRUE(test, state->quality_valid);
+	KUNIT_EXPECT_EQ(test, state->quality_req, 187);
+	KUNIT_EXPECT_EQ(test, state->quality_margin, 93);
+	KUNIT_EXPECT_EQ(test, state->quality_score, 93);
+	KUNIT_EXPECT_EQ(test, c->cnr.stat[0].scale, FE_SCALE_DECIBEL);
+	KUNIT_EXPECT_EQ(test, c->cnr.stat[0].svalue, 28000);
+
+	m->cnr = 250;
+	sit2_test_poll(test, 1000);
+	KUNIT_EXPECT_EQ(test, state->quality_margin, 63);
+	KUNIT_EXPECT_EQ(test, state->quality_score, 63);
+
+	/* below the requirement and past the span both clamp */
+	m->cnr = 150;
+	sit2_test_poll(test, 1000);
+	KUNIT_EXPECT_EQ(test, state->quality_margin, -37);
+	KUNIT_EXPECT_EQ(test, state->quality_score, 0);
+	m->cnr = 320;
+	sit2_test_poll(test, 1000);
+	KUNIT_EXPECT_EQ(test, state->quality_margin, 133);
+	KUNIT_EXPECT_EQ(test, state->quality_score, 100);
+
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t2) & FE_HAS_LOCK);
+	sit2_test_poll(test, 1000);
+	KUNIT_ASSERT_TRUE(test, state->quality_valid);
+	KUNIT_EXPECT_EQ(test, state->quality_req, 194);
+	KUNIT_EXPECT_EQ(test, state->quality_margin, 56);
+	KUNIT_EXPECT_EQ(test, state->quality_score, 56);
+
+	/* no lock, no score */
+	m = sit2_sim_find_mux(ctx->sim, sit2_test_mux_t2.frequency);
+	m->off = true;
+	sit2_test_poll(test, 1000);
+	KUNIT_EXPECT_FALSE(test, state->quality_valid);
+	KUNIT_EXPECT_EQ(test, c->cnr.stat[0].scale, FE_SCALE_NOT_AVAILABLE);
+}
+
+/* a 24 Mbit/s mux on the parallel bus gets a 3.6 MHz clock, 20% over a byte per clock */
+static void sit2_test_ts_clock(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	struct sit2_sim_mux empty = sit2_test_mux_t;
+	int adapt = sit2_ts_adapt, margin = sit2_ts_margin;
+	struct sit2_sim_mux *m;
+	fe_status_t status;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	m = sit2_sim_find_mux(ctx->sim, sit2_test_mux_t.frequency);
+	KUNIT_ASSERT_NOT_NULL(test, m);
+	m->ts_kbps = 24000;
+	sit2_ts_adapt = 1;
+	sit2_ts_margin = 20;
+	status = sit2_test_tune(test, &sit2_test_mux_t);
+	KUNIT_EXPECT_TRUE(test, status & FE_HAS_LOCK);
+	KUNIT_EXPECT_TRUE(test, state->ts_adapted);
+	KUNIT_EXPECT_EQ(test, state->ts_bit_rate, 2400);
+	KUNIT_EXPECT_EQ(test, state->ts_freq, 360);
+	KUNIT_EXPECT_EQ(test, ctx->sim->demod.props[0x100d], 360);
+	/* manual clock, continuous */
+	KUNIT_EXPECT_EQ(test, ctx->sim->demod.props[0x1001] & 0x70, 2 << 4);
+
+	/* the next acquisition starts from the init time setup */
+	empty.frequency = 650000000;
+	status = sit2_test_tune(test, &empty);
+	KUNIT_EXPECT_FALSE(test, status & FE_HAS_LOCK);
+	KUNIT_EXPECT_FALSE(test, state->ts_adapted);
+	KUNIT_EXPECT_EQ(test, ctx->sim->demod.props[0x100d], SIT2_TS_FREQ_DEFAULT);
+	KUNIT_EXPECT_EQ(test, ctx->sim->demod.props[0x1001] & 0x70, state->ts_clock << 4);
+	KUNIT_EXPECT_EQ(test, state->ts_adapts, 1);
+	sit2_ts_adapt = adapt;
+	sit2_ts_margin = margin;
+}
+
+/* below the RSSI floor the tune ends at the tuner, the demod is not restarted */
+static void sit2_test_rssi_floor(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	static const int floors[] = { -50, 10, -70 };
+	int floor = sit2_rssi_floor;
+	u32 restarts, status_cmds, skips;
+	fe_status_t status;
+	int i;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	/* the standard is set up, a change of it would restart the demod */
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	for (i = 0; i < ARRAY_SIZE(floors); i++) {
+		/* the mux comes in at -55 dBm */
+		sit2_rssi_floor = floors[i];
+		restarts = ctx->sim->stats.demod_cmds[0x85];
+		status_cmds = ctx->sim->stats.demod_cmds[0x87];
+		skips = state->rssi_floor_skips;
+		sit2_test_props(ctx->fe, &sit2_test_mux_t);
+		KUNIT_EXPECT_EQ(test, ctx->fe->ops.set_frontend(ctx->fe), 0);
+		cancel_delayed_work_sync(&state->stats_work);
+		if (floors[i] > -55) {
+			/* neither restarted nor polled for the lock */
+			KUNIT_EXPECT_EQ(test, state->rssi_floor_skips, skips + 1);
+			KUNIT_EXPECT_EQ(test, ctx->sim->stats.demod_cmds[0x85], restarts);
+			KUNIT_EXPECT_EQ(test, ctx->sim->stats.demod_cmds[0x87], status_cmds);
+		} else {
+			KUNIT_EXPECT_EQ(test, state->rssi_floor_skips, skips);
+			KUNIT_EXPECT_GT(test, ctx->sim->stats.demod_cmds[0x85], restarts);
+			ctx->fe->ops.read_status(ctx->fe, &status);
+			KUNIT_EXPECT_TRUE(test, status & FE_HAS_LOCK);
+		}
+	}
+	KUNIT_EXPECT_EQ(test, state->rssi_floor_checks, 3);
+	KUNIT_EXPECT_EQ(test, state->rssi_floor_skips, 2);
+	sit2_rssi_floor = floor;
+}
+
+static const char sit2_test_scan_list[] =
+	"t 474000000 8000000\n"
+	"t2 522000000 8000000 1\n"
+	"\n"
+	"c 346000000 6900000\n"
+	"t 650000000 8000000\n";
+
+/* virtual time at which the frontend thread asks for a tune, 0: never */
+static u64 sit2_test_tune_at_us;
+
+static ktime_t sit2_test_now_tune(void *priv)
+{
+	struct sit2_state *state = priv;
+
+	if (sit2_test_tune_at_us && (state->vclock_us >= sit2_test_tune_at_us)) {
+		sit2_test_tune_at_us = 0;
+		atomic_inc(&state->tune_gen);
+	}
+	return sit2_now(state);
+}
+
+static void sit2_test_scan(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	struct sit2_scan_result *res;
+	char *text;
+	int num;
+
+	res = kunit_kcalloc(test, SIT2_SCAN_MAX, sizeof(*res), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, res);
+	text = kunit_kzalloc(test, sizeof(sit2_test_scan_list), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, text);
+	strcpy(text, "x 474000000 8000000\n");
+	KUNIT_EXPECT_EQ(test, sit2_scan_parse(text, res), -EINVAL);
+	strcpy(text, "\n");
+	KUNIT_EXPECT_EQ(test, sit2_scan_parse(text, res), -EINVAL);
+	strcpy(text, sit2_test_scan_list);
+	num = sit2_scan_parse(text, res);
+	KUNIT_ASSERT_EQ(test, num, 4);
+	KUNIT_EXPECT_EQ(test, res[0].system, SYS_DVBT);
+	KUNIT_EXPECT_EQ(test, res[0].stream, -1);
+	KUNIT_EXPECT_EQ(test, res[1].system, SYS_DVBT2);
+	KUNIT_EXPECT_EQ(test, res[1].stream, 1);
+	KUNIT_EXPECT_EQ(test, res[2].system, SYS_DVBC_ANNEX_A);
+	KUNIT_EXPECT_EQ(test, res[2].rate, 6900000);
+	KUNIT_EXPECT_EQ(test, res[3].frequency, 650000000);
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_c) & FE_HAS_LOCK);
+	KUNIT_EXPECT_EQ(test, sit2_scan(state, res, num), 4);
+	KUNIT_EXPECT_TRUE(test, res[0].lock);
+	KUNIT_EXPECT_EQ(test, res[0].detected, 2);
+	KUNIT_EXPECT_GT(test, res[0].cnr, 0);
+	KUNIT_EXPECT_TRUE(test, res[1].lock);
+	KUNIT_EXPECT_EQ(test, res[1].detected, 7);
+	KUNIT_EXPECT_EQ(test, res[1].num_plp, 2);
+	KUNIT_EXPECT_TRUE(test, res[2].lock);
+	KUNIT_EXPECT_EQ(test, res[2].detected, 3);
+	KUNIT_EXPECT_FALSE(test, res[3].lock);
+	KUNIT_EXPECT_EQ(test, state->scans, 1);
+	KUNIT_EXPECT_EQ(test, state->scan_stops, 0);
+	/* the running frontend goes back to its own channel */
+	KUNIT_EXPECT_TRUE(test, state->retune_pending);
+	KUNIT_EXPECT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_c) & FE_HAS_LOCK);
+
+	/* a tune request during the first entry stops the scan after it */
+	memset(res, 0, num * sizeof(*res));
+	strcpy(text, sit2_test_scan_list);
+	KUNIT_ASSERT_EQ(test, sit2_scan_parse(text, res), num);
+	sit2_test_tune_at_us = state->vclock_us + 1;
+	ctx->sim->now = sit2_test_now_tune;
+	KUNIT_EXPECT_EQ(test, sit2_scan(state, res, num), 1);
+	ctx->sim->now = sit2_test_now;
+	KUNIT_EXPECT_EQ(test, sit2_test_tune_at_us, 0);
+	KUNIT_EXPECT_TRUE(test, res[0].lock);
+	KUNIT_EXPECT_EQ(test, state->scans, 2);
+	KUNIT_EXPECT_EQ(test, state->scan_stops, 1);
+	/* that tune puts the frontend where it wants to be */
+	KUNIT_EXPECT_FALSE(test, state->retune_pending);
+}
+
+/* the L1 signalling is read when debugfs asks for it, not on every tune */
+static void sit2_test_t2_l1(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	struct sit2_state *state = ctx->state;
+	struct seq_file m = { .size = 1024, .private = state };
+	u32 plp_info;
+
+	m.buf = kunit_kzalloc(test, m.size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, m.buf);
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	sit2_debugfs_t2_l1_show(&m, NULL);
+	KUNIT_EXPECT_STREQ(test, m.buf, "no T2 lock\n");
+
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t2) & FE_HAS_LOCK);
+	KUNIT_EXPECT_EQ(test, state->t2_l1_reads, 0);
+	plp_info = ctx->sim->stats.demod_cmds[0x53];
+	KUNIT_EXPECT_EQ(test, plp_info, 0);
+	m.count = 0;
+	sit2_debugfs_t2_l1_show(&m, NULL);
+	KUNIT_EXPECT_EQ(test, state->t2_l1_reads, 1);
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.demod_cmds[0x53], 2);
+	KUNIT_EXPECT_NOT_NULL(test, strstr(m.buf, "cell_id: 0x000a\n"));
+	KUNIT_EXPECT_NOT_NULL(test, strstr(m.buf, "network_id: 0x0001\n"));
+	KUNIT_EXPECT_NOT_NULL(test, strstr(m.buf, "t2_system_id: 0x0002\n"));
+	KUNIT_EXPECT_NOT_NULL(test, strstr(m.buf, "plps: 2\n"));
+	KUNIT_EXPECT_EQ(test, state->t2_plp_num, 2);
+	KUNIT_EXPECT_EQ(test, state->t2_plp[1].plp_id, 1);
+	KUNIT_EXPECT_EQ(test, state->t2_plp[1].plp_type, 1);
+	KUNIT_EXPECT_EQ(test, state->t2_plp[1].payload_type, 3);
+	KUNIT_EXPECT_EQ(test, sit2_convert_coderate(state->t2_plp[1].cod), FEC_3_5);
+	KUNIT_EXPECT_EQ(test, sit2_convert_modulation(state->t2_plp[1].mod), QAM_256);
+
+	/* cached until the next tune */
+	m.count = 0;
+	sit2_debugfs_t2_l1_show(&m, NULL);
+	KUNIT_EXPECT_EQ(test, state->t2_l1_reads, 1);
+	KUNIT_EXPECT_EQ(test, ctx->sim->stats.demod_cmds[0x53], 2);
+}
+
+static void sit2_test_recover_bus_error(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	fe_status_t status;
+	int i;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+	/* more NAKs than the retries cover */
+	ctx->sim->nak_xfers = 2 * (max(sit2_retry_max, 0) + 1);
+	ctx->fe->ops.read_status(ctx->fe, &status);
+	KUNIT_EXPECT_GT(test, ctx->state->err_i2c, 0);
+	KUNIT_EXPECT_GT(test, ctx->state->cmd_fails, 0);
+	KUNIT_EXPECT_EQ(test, ctx->state->recover_level, SIT2_RECOVER_DEMOD_RESTART);
+	/* a single hiccup does not escalate further */
+	for (i = 0; i < 3; i++) {
+		ctx->fe->ops.read_status(ctx->fe, &status);
+		KUNIT_EXPECT_EQ(test, ctx->state->recover_level, SIT2_RECOVER_NONE);
+	}
+	KUNIT_EXPECT_EQ(test, ctx->state->rec_cold_inits, 0);
+	KUNIT_EXPECT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t) & FE_HAS_LOCK);
+}
+
+static void sit2_test_recover_timeout(struct kunit *test)
+{
+	struct sit2_test_ctx *ctx = test->priv;
+	fe_status_t status;
+	u64 xfers;
+
+	KUNIT_ASSERT_EQ(test, ctx->fe->ops.init(ctx->fe), 0);
+	KUNIT_ASSERT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t2) & FE_HAS_LOCK);
+	/* a hang the retries do not get past */
+	ctx->sim->hang_cmds = max(sit2_retry_max, 0) + 1;
+	xfers = ctx->state->op_stats[SIT2_OP_STATUS].xfers;
+	ctx->fe->ops.read_status(ctx->fe, &status);
+	/* the CTS poll backs off instead of reading every millisecond */
+	xfers = ctx->state->op_stats[SIT2_OP_STATUS].xfers - xfers;
+	KUNIT_EXPECT_LE(test, xfers, (max(sit2_retry_max, 0) + 1) * 64 + 16);
+	KUNIT_EXPECT_EQ(test, ctx->state->err_timeout, 1);
+	KUNIT_EXPECT_EQ(test, ctx->state->rec_retries, max(sit2_retry_max, 0));
+	KUNIT_EXPECT_EQ(test, ctx->state->recover_level, SIT2_RECOVER_DEMOD_RESTART);
+	KUNIT_EXPECT_TRUE(test, sit2_test_tune(test, &sit2_test_mux_t2) & FE_HAS_LOCK);
+}
+
+static struct kunit_case sit2_test_cases[] = {
+	KUNIT_CASE(sit2_test_cold_init),
+	KUNIT_CASE(sit2_test_tune_dvbt),
+	KUNIT_CASE(sit2_test_tune_dvbt2),
+	KUNIT_CASE(sit2_test_tune_dvbc),
+	KUNIT_CASE(sit2_test_dvbc_auto),
+	KUNIT_CASE(sit2_test_dvbc_auto_rate),
+	KUNIT_CASE(sit2_test_no_signal),
+	KUNIT_CASE(sit2_test_lock_model),
+	KUNIT_CASE(sit2_test_warm_resume),
+	KUNIT_CASE(sit2_test_resume_lost_fw),
+	KUNIT_CASE(sit2_test_adopt_standby),
+	KUNIT_CASE(sit2_test_system_sleep),
+	KUNIT_CASE(sit2_test_stats_counters),
+	KUNIT_CASE(sit2_test_quality),
+	KUNIT_CASE(sit2_test_ts_clock),
+	KUNIT_CASE(sit2_test_rssi_floor),
+	KUNIT_CASE(sit2_test_scan),
+	KUNIT_CASE(sit2_test_t2_l1),
+	KUNIT_CASE(sit2_test_recover_bus_error),
+	KUNIT_CASE(sit2_test_recover_timeout),
+	KUNIT_CASE(sit2_test_watchdog),
+	KUNIT_CASE(sit2_test_watchdog_restart),
+	KUNIT_CASE(sit2_test_watchdog_cold_init),
+	{}
+};
+
+static struct kunit_suite sit2_test_suite = {
+	.name = "sit2",
+	.init = sit2_test_init,
+	.exit = sit2_test_exit,
+	.test_cases = sit2_test_cases,
+};
+
+kunit_test_suite(sit2_test_suite);